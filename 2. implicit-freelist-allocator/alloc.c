@@ -6,43 +6,393 @@
  * for a 32-bit machine (WORD = 4, DWORD = 8).
  *
  * Layout of a block:
- *    [ header | payload... | footer ]
+ *    allocated: [ header | payload... ]
+ *    free:      [ header | ... | footer ]
+ *
+ * Only free blocks carry a footer: coalescing needs it only when the
+ * previous block is free, and every header says whether its predecessor
+ * is allocated (PREV_ALLOC), so an allocated block saves a word.
  *
  * Prologue block: allocated block of size DWORD to make edge conditions simpler.
  * Epilogue header: zero-size allocated block at the end of the heap.
+ *
+ * The heap lives in HEAP_RESERVE bytes of address space reserved PROT_NONE
+ * with mmap, and pages are committed with mprotect as it grows, so the
+ * program break (and whoever else uses it) is left alone. Each commit
+ * grows the heap by its current size, between GROW_MIN and GROW_MAX bytes
+ * (tunable at run time with my_heap_growth), so a heap ramping up to
+ * gigabytes makes a few thousand mprotect calls rather than one per page.
+ * A trim shrinks the heap and, with it, the next step.
+ *
+ * Freed memory is returned to the OS: a top free block larger than
+ * TRIM_THRESHOLD decommits the heap's tail, and every RELEASE_THRESHOLD
+ * bytes of frees the whole pages inside large free blocks are madvise'd.
+ *
+ * Built with -DHUGEPAGES, the reservation is 2 MB aligned, the heap is
+ * committed, trimmed and released in 2 MB steps, and the kernel is asked
+ * for transparent huge pages (MADV_HUGEPAGE) to cut dTLB misses. Kernels
+ * without THP ignore the advice.
+ *
+ * my_malloc_stats reports heap usage from counters kept up to date by every
+ * operation, so reading them rarely walks the heap (see my_malloc_stats).
+ *
+ * Built with -DNEXT_FIT, find_fit resumes where the last search stopped
+ * (the rover) instead of at the start of the heap, so it does not rescan
+ * the allocated blocks at the front on every call.
+ *
+ * Built with -DFIT_INDEX, a three-level bitmap records which DWORD
+ * granules start a free block, and each 64 KB region keeps an upper bound
+ * on its largest free block. find_fit jumps between free blocks with ctz
+ * and skips regions with nothing free or nothing big enough, so allocated
+ * headers are never read. The search order (first or next fit) is kept.
+ *
+ * Built with -DCOMPACT_TAGS, headers and footers are 32-bit words: the
+ * header overhead of an allocated block halves and the minimum block
+ * drops to DWORD bytes. Block sizes, and so HEAP_RESERVE, must then stay
+ * under 4 GB.
  */
 
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/mman.h>
 
+#ifdef COMPACT_TAGS
+#define WORD 4              // header/footer size in bytes: 32-bit tags
+typedef uint32_t tag_t;
+#else
 #define WORD 8              // machine word size in bytes (8 on 64-bit, 4 on 32-bit)
-#define DWORD 16            // double word size (alignment). For 32-bit machines use 8.
+typedef uintptr_t tag_t;
+#endif
+#define DWORD 16            // payload alignment. For 32-bit machines use 8.
+#define MIN_BLOCK (4 * WORD) // header, footer and a minimum payload once free
 #define CHUNKSIZE (1 << 12) // initial heap extension size (4KB)
 
-/* Read and write a word at address p (use uintptr_t for correct size) */
-#define GET(p) (*(uintptr_t *)(p))
-#define PUT(p, val) (*(uintptr_t *)(p) = (val))
+#ifndef HEAP_RESERVE
+#define HEAP_RESERVE (1UL << 30) // address space reserved for the heap; only used pages are committed
+#endif
+#if defined(COMPACT_TAGS) && HEAP_RESERVE > (1UL << 32) - DWORD
+#error "COMPACT_TAGS needs HEAP_RESERVE below 4 GB"
+#endif
+
+/* Returning memory to the OS; override with -D to tune */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (128 * 1024) // shrink the heap when its top free block exceeds this
+#endif
+#define TRIM_KEEP CHUNKSIZE // bytes left in the top block after a trim
+#ifndef RELEASE_THRESHOLD
+#define RELEASE_THRESHOLD (1024 * 1024) // bytes freed between madvise passes
+#endif
+
+/* Heap growth: a commit adds the heap's current size, clamped to [GROW_MIN, GROW_MAX] */
+#ifndef GROW_MIN
+#define GROW_MIN CHUNKSIZE
+#endif
+#ifndef GROW_MAX
+#define GROW_MAX (1024 * 1024)
+#endif
+
+#ifdef HUGEPAGES
+#define HUGE_PAGE_SIZE (2UL << 20) // commit granule; HEAP_RESERVE must be a multiple
+#endif
+
+#ifdef FIT_INDEX
+#define IDX_GRANULES (HEAP_RESERVE / DWORD)  // level 0: one bit per DWORD granule of the reservation
+#define IDX_REGION_GRANULES (64 * 64)        // level 1: one bit per level-0 word, one word per region (64 KB)
+#define IDX_REGIONS (IDX_GRANULES / IDX_REGION_GRANULES) // level 2: one bit per region
+#endif
+
+/* Read and write a header/footer word at address p */
+#define GET(p) (*(tag_t *)(p))
+#define PUT(p, val) (*(tag_t *)(p) = (tag_t)(val))
 
 /* Pack a size and allocated bit into a header/footer word */
 #define PACK(size, alloc) ((size) | (alloc))
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
 /* Read the size and allocated fields from address p (header/footer) */
 #define GET_SIZE(p) (GET(p) & ~(DWORD - 1)) /* mask out alloc bit(s) */
 #define GET_ALLOC(p) (GET(p) & 0x1)         /* allocation bit is LSB */
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Header flag: the previous block is allocated (so this block has no footer to read behind it) */
+#define PREV_ALLOC 0x2
+
+/* Set or clear the PREV_ALLOC flag in block bp's header */
+#define SET_PREV_ALLOC(bp) PUT(HDRP(bp), GET(HDRP(bp)) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(bp) PUT(HDRP(bp), GET(HDRP(bp)) & ~(tag_t)PREV_ALLOC)
 
 /* Given block pointer bp (points to payload), compute addresses of header/footer */
 #define HDRP(bp) ((char *)(bp) - WORD)
-#define FTRP(bp) (((char *)(bp) + GET_SIZE(HDRP(bp))) - DWORD)
+#define FTRP(bp) (((char *)(bp) + GET_SIZE(HDRP(bp))) - 2 * WORD)
 
 /* Given block pointer bp, compute pointer to next and previous blocks' payload */
 #define NXT_BLOCK(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
-#define PRV_BLOCK(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - DWORD))
+#define PRV_BLOCK(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - 2 * WORD))
 
 /* Pointer to first block's payload (after prologue) */
 static char *heap_list_p = 0;
 
+/* Reserved range [heap_lo, heap_lo + HEAP_RESERVE); blocks end at heap_hi, pages are read/write up to heap_committed */
+static char *heap_lo = 0;
+static char *heap_hi;
+static char *heap_committed;
+
+#ifdef NEXT_FIT
+/* Block the next search starts at; always a block start, never the epilogue */
+static char *rover;
+#endif
+
+#ifdef FIT_INDEX
+/*
+ * Free-block index, mapped next to the reservation:
+ *   l0[g / 64] bit g       granule g starts a free block
+ *   l1[r] bit j            l0 word 64 * r + j is not zero
+ *   l2[r / 64] bit r       region r has a free block
+ *   max[r]                 no free block starting in region r is larger
+ * max[] only goes up on insert, so it may overstate; a search that scans
+ * a whole region without a fit stores the exact value. Its entries are
+ * block sizes, so they are as wide as a header.
+ */
+typedef struct fit_index_t
+{
+    uint64_t l0[IDX_GRANULES / 64];
+    uint64_t l1[IDX_REGIONS];
+    uint64_t l2[IDX_REGIONS / 64];
+    tag_t max[IDX_REGIONS];
+} fit_index_t;
+
+static fit_index_t *idx;
+#endif
+
+/* Bytes freed since the last madvise pass */
+static size_t dirty_bytes = 0;
+
+/* Growth policy, see my_heap_growth */
+static size_t grow_min = GROW_MIN;
+static size_t grow_max = GROW_MAX;
+
+/* Heap usage counters, see my_malloc_stats */
+typedef struct malloc_stats_t
+{
+    size_t heap_bytes;      /* heap extent: prologue, blocks and epilogue */
+    size_t committed_bytes; /* read/write pages backing the heap */
+    size_t allocated_bytes; /* in allocated blocks, boundary tags included */
+    size_t free_bytes;      /* in free blocks, boundary tags included */
+    size_t free_blocks;
+    size_t largest_free;    /* size of the largest free block */
+    size_t mallocs;         /* successful my_malloc calls */
+    size_t frees;
+    size_t heap_grows;      /* extend_heap calls */
+    size_t heap_commits;    /* mprotect calls that committed pages */
+    size_t heap_trims;      /* heap_trim calls that decommitted pages */
+    size_t search_steps;    /* blocks find_fit examined */
+    size_t largest_searches; /* reads that searched for largest_free */
+} malloc_stats_t;
+
+static malloc_stats_t stats;
+static int largest_stale = 0; /* the largest free block left the free set; recompute on read */
+/*
+ * Upper bound on every free block but one of size largest_free (on every
+ * free block while largest_stale). A block at least this big that joins
+ * the free set is the exact largest again, so the usual malloc, which
+ * takes the top block and puts its remainder back, needs no search.
+ */
+static size_t other_free_bound = 0;
+
+/* Unit the heap is committed, trimmed and released in: a huge page, or the system page size */
+#ifdef HUGEPAGES
+#define CORE_GRANULE HUGE_PAGE_SIZE
+#else
+static size_t page_align(size_t size)
+{
+    static size_t page_size;
+
+    if (page_size == 0)
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+#define CORE_GRANULE page_align(1)
+#endif
+
+/* Round an address up/down to CORE_GRANULE */
+static char *core_ceil(char *p)
+{
+    return (char *)(((uintptr_t)p + CORE_GRANULE - 1) & ~(CORE_GRANULE - 1));
+}
+
+static char *core_floor(char *p)
+{
+    return (char *)((uintptr_t)p & ~(CORE_GRANULE - 1));
+}
+
+/* A free block of 'size' bytes appeared, as a new block or by merging: update the largest */
+static void stat_bound_free(size_t size)
+{
+    if (largest_stale)
+    {
+        if (size >= other_free_bound)
+        {
+            stats.largest_free = size; /* bounds every other block */
+            largest_stale = 0;
+        }
+    }
+    else if (size > stats.largest_free)
+    {
+        other_free_bound = MAX(other_free_bound, stats.largest_free);
+        stats.largest_free = size;
+    }
+    else
+    {
+        other_free_bound = MAX(other_free_bound, size);
+    }
+}
+
+/* Free blocks merged into one of 'size' bytes; 'part' is the biggest of them */
+static void stat_merge_free(size_t size, size_t part)
+{
+    if (!largest_stale && part == stats.largest_free)
+        stats.largest_free = size; /* the largest grew: the bound on the others holds */
+    else
+        stat_bound_free(size);
+}
+
+/* A free block of 'size' bytes joins the free set */
+static void stat_add_free(size_t size)
+{
+    stats.free_bytes += size;
+    stats.free_blocks++;
+    stat_bound_free(size);
+}
+
+/* A free block of 'size' bytes leaves the free set (allocated or trimmed) */
+static void stat_take_free(size_t size)
+{
+    stats.free_bytes -= size;
+    stats.free_blocks--;
+    if (!largest_stale && size == stats.largest_free)
+        largest_stale = 1;
+}
+
+#ifdef FIT_INDEX
+/* Record free block bp of 'size' bytes (new, or grown by a merge) */
+static void idx_set(char *bp, size_t size)
+{
+    size_t g = (bp - heap_lo) / DWORD;
+    size_t r = g / IDX_REGION_GRANULES;
+
+    idx->l0[g / 64] |= 1UL << (g % 64);
+    idx->l1[r] |= 1UL << (g / 64 % 64);
+    idx->l2[r / 64] |= 1UL << (r % 64);
+    if (size > idx->max[r])
+        idx->max[r] = size;
+}
+
+/* Forget free block bp: allocated, or absorbed by a merge */
+static void idx_clear(char *bp)
+{
+    size_t g = (bp - heap_lo) / DWORD;
+    size_t r = g / IDX_REGION_GRANULES;
+
+    if ((idx->l0[g / 64] &= ~(1UL << (g % 64))) != 0)
+        return;
+    if ((idx->l1[r] &= ~(1UL << (g / 64 % 64))) != 0)
+        return;
+    idx->l2[r / 64] &= ~(1UL << (r % 64));
+    idx->max[r] = 0;
+}
+
+/* First region in [r, rend) that has a free block, or rend */
+static size_t idx_next_region(size_t r, size_t rend)
+{
+    while (r < rend)
+    {
+        uint64_t word = idx->l2[r / 64] & (~0UL << (r % 64));
+        if (word != 0)
+            return MIN(r - r % 64 + __builtin_ctzl(word), rend);
+        r = r - r % 64 + 64;
+    }
+    return rend;
+}
+
+/*
+ * idx_search - first free block of at least 'size' bytes whose payload
+ * starts in [from, to), in address order. Only regions whose bound allows
+ * a fit are visited, and inside them only set bits, found with ctz.
+ */
+static char *idx_search(char *from, char *to, size_t size)
+{
+    size_t g = (from - heap_lo) / DWORD;
+    size_t gend = (to - heap_lo) / DWORD;
+    size_t rend = (gend + IDX_REGION_GRANULES - 1) / IDX_REGION_GRANULES;
+
+    for (size_t r = idx_next_region(g / IDX_REGION_GRANULES, rend); r < rend; r = idx_next_region(r + 1, rend))
+    {
+        if (idx->max[r] < size)
+            continue;
+
+        size_t lo = MAX(g, r * IDX_REGION_GRANULES);
+        size_t hi = MIN(gend, (r + 1) * IDX_REGION_GRANULES);
+        uint64_t words = idx->l1[r] & (~0UL << (lo / 64 % 64));
+        /* Nothing indexed in the region before lo: a scan to its end sees every block */
+        int whole = hi == (r + 1) * IDX_REGION_GRANULES && (idx->l1[r] & ~words) == 0 &&
+                    (idx->l0[lo / 64] & ((1UL << (lo % 64)) - 1)) == 0;
+        size_t largest = 0;
+
+        while (words != 0)
+        {
+            size_t w = r * 64 + __builtin_ctzl(words);
+            uint64_t bits = idx->l0[w];
+
+            words &= words - 1;
+            if (w == lo / 64)
+                bits &= ~0UL << (lo % 64);
+            for (; bits != 0; bits &= bits - 1)
+            {
+                size_t b = w * 64 + __builtin_ctzl(bits);
+                if (b >= hi)
+                    break;
+                char *bp = heap_lo + b * DWORD;
+                size_t bsize = GET_SIZE(HDRP(bp));
+                stats.search_steps++;
+                if (bsize >= size)
+                    return bp;
+                largest = MAX(largest, bsize);
+            }
+        }
+
+        /* Scanned the whole region: its bound is exact now */
+        if (whole)
+            idx->max[r] = largest;
+    }
+    return NULL;
+}
+
+/* Largest free block, visiting only indexed blocks in regions whose bound could beat the best so far */
+static size_t idx_largest(void)
+{
+    size_t rend = ((heap_hi - heap_lo) / DWORD + IDX_REGION_GRANULES - 1) / IDX_REGION_GRANULES;
+    size_t largest = 0;
+
+    for (size_t r = idx_next_region(0, rend); r < rend; r = idx_next_region(r + 1, rend))
+    {
+        if (idx->max[r] <= largest)
+            continue;
+        for (uint64_t words = idx->l1[r]; words != 0; words &= words - 1)
+        {
+            size_t w = r * 64 + __builtin_ctzl(words);
+            for (uint64_t bits = idx->l0[w]; bits != 0; bits &= bits - 1)
+                largest = MAX(largest, GET_SIZE(HDRP(heap_lo + (w * 64 + __builtin_ctzl(bits)) * DWORD)));
+        }
+    }
+    return largest;
+}
+#else
+#define idx_set(bp, size) ((void)0)
+#define idx_clear(bp) ((void)0)
+#endif
+
 /*
  * coalesce - boundary-tag coalescing. Return pointer to coalesced block.
  * Four cases:
@@ -53,9 +403,10 @@ static char *heap_list_p = 0;
  */
 static void *coalesce(void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PRV_BLOCK(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NXT_BLOCK(bp)));
     size_t size = GET_SIZE(HDRP(bp));
+    size_t part = size; /* biggest merged block */
 
     if (prev_alloc && next_alloc)
     {
@@ -64,32 +415,137 @@ static void *coalesce(void *bp)
     else if (prev_alloc && !next_alloc)
     {
         /* Case 2: merge with next block */
+        idx_clear(NXT_BLOCK(bp));
+        part = MAX(part, GET_SIZE(HDRP(NXT_BLOCK(bp))));
         size += GET_SIZE(HDRP(NXT_BLOCK(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
+        stats.free_blocks--;
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
     }
     else if (!prev_alloc && next_alloc)
     {
         /* Case 3: merge with previous block */
+        idx_clear(bp);
+        part = MAX(part, GET_SIZE(FTRP(PRV_BLOCK(bp))));
         size += GET_SIZE(FTRP(PRV_BLOCK(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, 0));
+        stats.free_blocks--;
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, PREV_ALLOC));
         bp = PRV_BLOCK(bp); /* new payload pointer is at previous block */
     }
     else
     {
         /* Case 4: merge with both previous and next */
+        idx_clear(bp);
+        idx_clear(NXT_BLOCK(bp));
+        part = MAX(part, MAX(GET_SIZE(FTRP(PRV_BLOCK(bp))), GET_SIZE(HDRP(NXT_BLOCK(bp)))));
         size += GET_SIZE(FTRP(PRV_BLOCK(bp))) + GET_SIZE(HDRP(NXT_BLOCK(bp)));
-        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, 0));
-        PUT(FTRP(NXT_BLOCK(bp)), PACK(size, 0));
+        stats.free_blocks -= 2;
+        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, PREV_ALLOC));
+        PUT(FTRP(NXT_BLOCK(bp)), PACK(size, PREV_ALLOC));
         bp = PRV_BLOCK(bp);
     }
+
+    /* The next block (allocated, or the epilogue) now follows a free block */
+    CLR_PREV_ALLOC(NXT_BLOCK(bp));
+    idx_set(bp, size);
+
+#ifdef NEXT_FIT
+    /* The rover may point at a block that was just absorbed */
+    if (rover > (char *)bp && rover < NXT_BLOCK(bp))
+        rover = bp;
+#endif
+
+    /* Merging frees no bytes, but the result may be the new largest block */
+    if (size != part)
+        stat_merge_free(size, part);
     return bp;
 }
 
+/*
+ * heap_reserve - map a fresh PROT_NONE reservation, dropping the old heap
+ * Returns 0 on success, -1 on error
+ */
+static int heap_reserve(void)
+{
+    if (heap_lo != 0)
+        munmap(heap_lo, HEAP_RESERVE);
+
+#ifdef FIT_INDEX
+    /* A fresh, all-zero index: pages are only touched where the heap has blocks */
+    if (idx != NULL)
+        munmap(idx, sizeof(fit_index_t));
+    idx = mmap(NULL, sizeof(fit_index_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (idx == MAP_FAILED)
+    {
+        idx = NULL;
+        heap_lo = 0;
+        return -1;
+    }
+#endif
+
+#ifdef HUGEPAGES
+    /* Over-reserve by one huge page and cut out an aligned range */
+    char *raw = mmap(NULL, HEAP_RESERVE + HUGE_PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        heap_lo = 0;
+        return -1;
+    }
+    heap_lo = core_ceil(raw);
+    if (heap_lo > raw)
+        munmap(raw, heap_lo - raw);
+    munmap(heap_lo + HEAP_RESERVE, raw + HUGE_PAGE_SIZE - heap_lo);
+    madvise(heap_lo, HEAP_RESERVE, MADV_HUGEPAGE); /* best effort: fails harmlessly without THP */
+#else
+    heap_lo = mmap(NULL, HEAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap_lo == MAP_FAILED)
+    {
+        heap_lo = 0;
+        return -1;
+    }
+#endif
+    heap_hi = heap_committed = heap_lo;
+    return 0;
+}
+
+/*
+ * heap_more_core - sbrk replacement: grow the heap by 'size' bytes, committing
+ * whole pages as needed. A commit covers at least the growth policy's step,
+ * so pages are committed ahead of heap_hi. With HUGEPAGES each committed
+ * range is advised again, as a trim may have remapped it since the
+ * reservation was. Returns the old heap end, or (void *)-1 when the
+ * reservation is exhausted.
+ */
+static void *heap_more_core(size_t size)
+{
+    char *old_hi = heap_hi;
+
+    if ((size_t)(heap_lo + HEAP_RESERVE - old_hi) < size)
+        return (void *)-1;
+
+    if (old_hi + size > heap_committed)
+    {
+        /* Geometric step: the committed size again, within the policy's bounds */
+        size_t step = MIN(MAX((size_t)(heap_committed - heap_lo), grow_min), grow_max);
+        char *commit_end = core_ceil(MAX(old_hi + size, heap_committed + step));
+
+        commit_end = MIN(commit_end, heap_lo + HEAP_RESERVE);
+        if (mprotect(heap_committed, commit_end - heap_committed, PROT_READ | PROT_WRITE) != 0)
+            return (void *)-1;
+#ifdef HUGEPAGES
+        madvise(heap_committed, commit_end - heap_committed, MADV_HUGEPAGE); /* heap_trim's remap drops the advice */
+#endif
+        heap_committed = commit_end;
+        stats.heap_commits++;
+    }
+    heap_hi = old_hi + size;
+    return old_hi;
+}
+
 /*
  * extend_heap - extend heap by 'words' words, return pointer to new free block's payload
- * We ensure alignment by making the size an even number of WORDs (so result is multiple of DWORD).
+ * We ensure alignment by rounding the size up to a multiple of DWORD.
  */
 static void *extend_heap(size_t words)
 {
@@ -97,15 +553,18 @@ static void *extend_heap(size_t words)
     size_t size;
 
     /* Ensure the block size is a multiple of DWORD for alignment */
-    size = (words % 2) ? (words + 1) * WORD : words * WORD;
+    size = DWORD * ((words * WORD + (DWORD - 1)) / DWORD);
 
-    if ((long)(bp = sbrk(size)) == -1)
+    if ((bp = heap_more_core(size)) == (void *)-1)
         return NULL;
 
     /* Initialize free block header/footer and new epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
-    PUT(HDRP(NXT_BLOCK(bp)), PACK(0, 1)); /* new epilogue header */
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp)); /* kept in the old epilogue header */
+    PUT(HDRP(bp), PACK(size, prev_alloc));  /* free block header */
+    PUT(FTRP(bp), PACK(size, prev_alloc));  /* free block footer */
+    PUT(HDRP(NXT_BLOCK(bp)), PACK(0, 1));   /* new epilogue header */
+    stats.heap_grows++;
+    stat_add_free(size);
 
     return coalesce(bp);
 }
@@ -116,15 +575,22 @@ static void *extend_heap(size_t words)
  */
 int mminit(void)
 {
-    /* Create initial empty heap: 4 words for alignment/prologue/epilogue */
-    if ((heap_list_p = sbrk(4 * WORD)) == (void *)(-1))
+    /* Create initial empty heap: 2 DWORDs for alignment/prologue/epilogue */
+    if (heap_reserve() == -1 || (heap_list_p = heap_more_core(2 * DWORD)) == (void *)(-1))
         return -1;
 
-    PUT(heap_list_p, 0);                           /* alignment padding */
-    PUT(heap_list_p + WORD, PACK(DWORD, 1));       /* prologue header (allocated) */
-    PUT(heap_list_p + (2 * WORD), PACK(DWORD, 1)); /* prologue footer (allocated) */
-    PUT(heap_list_p + (3 * WORD), PACK(0, 1));     /* epilogue header (allocated) */
-    heap_list_p += (2 * WORD);                     /* heap_list_p now points to prologue payload */
+    PUT(heap_list_p, 0);                                          /* alignment padding */
+    PUT(heap_list_p + DWORD - WORD, PACK(DWORD, 1));              /* prologue header (allocated) */
+    PUT(heap_list_p + 2 * DWORD - 2 * WORD, PACK(DWORD, 1));      /* prologue footer (allocated) */
+    PUT(heap_list_p + 2 * DWORD - WORD, PACK(0, PREV_ALLOC | 1)); /* epilogue header (allocated) */
+    heap_list_p += DWORD;                                         /* heap_list_p now points to prologue payload */
+    dirty_bytes = 0;
+    stats = (malloc_stats_t){0};
+    largest_stale = 0;
+    other_free_bound = 0;
+#ifdef NEXT_FIT
+    rover = heap_list_p;
+#endif
 
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE / WORD) == NULL)
@@ -132,6 +598,53 @@ int mminit(void)
     return 0;
 }
 
+#ifdef FIT_INDEX
+/*
+ * find_fit - index-driven search for a free block with at least 'size' bytes (including header/footer)
+ * Same order as the scans below (next fit from the rover with -DNEXT_FIT,
+ * else first fit), but only free blocks in promising regions are read.
+ * Returns payload pointer (bp) or NULL if no fit found.
+ */
+static void *find_fit(size_t size)
+{
+#ifdef NEXT_FIT
+    char *bp = idx_search(rover, heap_hi, size);
+
+    if (bp == NULL)
+        bp = idx_search(heap_list_p, rover, size);
+    if (bp != NULL)
+        rover = bp;
+    return bp;
+#else
+    return idx_search(heap_list_p, heap_hi, size);
+#endif
+}
+#elif defined(NEXT_FIT)
+/*
+ * find_fit - next-fit search for a free block with at least 'size' bytes (including header/footer)
+ * Scans from the rover to the end of the heap, then wraps around from the
+ * start up to the rover. The rover is left on the block found.
+ * Returns payload pointer (bp) or NULL if no fit found.
+ */
+static void *find_fit(size_t size)
+{
+    char *bp;
+
+    for (bp = rover; GET_SIZE(HDRP(bp)) > 0; bp = NXT_BLOCK(bp))
+    {
+        stats.search_steps++;
+        if (!GET_ALLOC(HDRP(bp)) && (GET_SIZE(HDRP(bp)) >= size))
+            return rover = bp;
+    }
+    for (bp = heap_list_p; bp < rover; bp = NXT_BLOCK(bp))
+    {
+        stats.search_steps++;
+        if (!GET_ALLOC(HDRP(bp)) && (GET_SIZE(HDRP(bp)) >= size))
+            return rover = bp;
+    }
+    return NULL; /* no fit found */
+}
+#else
 /*
  * find_fit - first-fit search for a free block with at least 'size' bytes (including header/footer)
  * Returns payload pointer (bp) or NULL if no fit found.
@@ -142,6 +655,7 @@ static void *find_fit(size_t size)
 
     for (bp = heap_list_p; GET_SIZE(HDRP(bp)) > 0; bp = NXT_BLOCK(bp))
     {
+        stats.search_steps++;
         if (!GET_ALLOC(HDRP(bp)) && (GET_SIZE(HDRP(bp)) >= size))
         {
             return bp; /* found a fit */
@@ -149,31 +663,38 @@ static void *find_fit(size_t size)
     }
     return NULL; /* no fit found */
 }
+#endif
 
 /*
  * place - place a block of 'size' bytes at start of free block bp
- * If the remainder would be at least the minimum block size (2*DWORD), split the block.
+ * If the remainder would be at least the minimum block size (MIN_BLOCK), split the block.
  */
 static void place(void *bp, size_t size)
 {
     size_t asize = GET_SIZE(HDRP(bp));
 
-    if ((asize - size) >= (2 * DWORD))
+    stat_take_free(asize);
+    idx_clear(bp);
+    if ((asize - size) >= MIN_BLOCK)
     {
         /* Split: allocate front part and leave remainder as free block */
-        PUT(HDRP(bp), PACK((size), 1));
-        PUT(FTRP(bp), PACK((size), 1));
+        PUT(HDRP(bp), PACK((size), PREV_ALLOC | 1));
 
         /* Set header/footer for the remaining free block */
-        PUT(HDRP(NXT_BLOCK(bp)), PACK((asize - size), 0));
-        PUT(FTRP(NXT_BLOCK(bp)), PACK((asize - size), 0));
+        PUT(HDRP(NXT_BLOCK(bp)), PACK((asize - size), PREV_ALLOC));
+        PUT(FTRP(NXT_BLOCK(bp)), PACK((asize - size), PREV_ALLOC));
+        idx_set(NXT_BLOCK(bp), asize - size);
+        stat_add_free(asize - size);
+        stats.allocated_bytes += size;
     }
     else
     {
         /* Do not split: mark whole block as allocated */
-        PUT(HDRP(bp), PACK((asize), 1));
-        PUT(FTRP(bp), PACK((asize), 1));
+        PUT(HDRP(bp), PACK((asize), PREV_ALLOC | 1));
+        SET_PREV_ALLOC(NXT_BLOCK(bp));
+        stats.allocated_bytes += asize;
     }
+    stats.mallocs++;
 }
 
 /*
@@ -194,12 +715,12 @@ void *my_malloc(size_t size)
         return NULL;
 
     /* Adjust block size to include overhead and to satisfy alignment requirements */
-    if (size <= DWORD)
-        asize = (2 * DWORD); /* minimum block size (header+footer+minimum payload) */
+    if (size + WORD <= MIN_BLOCK)
+        asize = MIN_BLOCK; /* minimum block size (header+footer+minimum payload once free) */
     else
     {
-        /* Round up to nearest multiple of DWORD and add header/footer */
-        asize = DWORD * ((size + DWORD + (DWORD - 1)) / DWORD);
+        /* Round up to nearest multiple of DWORD and add the header; allocated blocks have no footer */
+        asize = DWORD * ((size + WORD + (DWORD - 1)) / DWORD);
     }
 
     /* Search the free list for a fit */
@@ -213,20 +734,137 @@ void *my_malloc(size_t size)
     size_t extension = MAX(asize, CHUNKSIZE);
     if ((bp = extend_heap(extension / WORD)) != NULL)
     {
+#ifdef NEXT_FIT
+        rover = bp; /* what is left of the new space is where the next search should look */
+#endif
         place(bp, asize);
         return bp;
     }
     return NULL; /* out of memory */
 }
 
+/*
+ * heap_trim - shrink the heap under top free block bp, leaving TRIM_KEEP
+ * bytes (rounded so the new end is page, or huge page, aligned). The tail is remapped
+ * PROT_NONE, which frees its pages but keeps the address range reserved.
+ */
+static void heap_trim(char *bp)
+{
+    char *new_end = core_ceil(bp + TRIM_KEEP);
+
+    if (new_end >= heap_hi)
+        return;
+    if (mmap(new_end, heap_committed - new_end, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+        return;
+    heap_hi = heap_committed = new_end;
+    stats.heap_trims++;
+    stat_take_free(GET_SIZE(HDRP(bp)));
+    stat_add_free(new_end - (char *)bp);
+
+    PUT(HDRP(bp), PACK(new_end - (char *)bp, PREV_ALLOC)); /* shrunken top block */
+    PUT(FTRP(bp), PACK(new_end - (char *)bp, PREV_ALLOC));
+    PUT(HDRP(NXT_BLOCK(bp)), PACK(0, 1));          /* new epilogue header */
+}
+
+/*
+ * release_pages - madvise the whole pages inside every multi-page free block
+ * Header and footer pages stay resident so the heap walk keeps working.
+ */
+static void release_pages(void)
+{
+    char *bp;
+
+    for (bp = heap_list_p; GET_SIZE(HDRP(bp)) > 0; bp = NXT_BLOCK(bp))
+    {
+        if (GET_ALLOC(HDRP(bp)))
+            continue;
+
+        char *lo = core_ceil(bp);
+        char *hi = core_floor(FTRP(bp));
+        if (hi > lo)
+            madvise(lo, hi - lo, MADV_DONTNEED);
+    }
+    dirty_bytes = 0;
+}
+
 /*
  * my_free - free a previously allocated block and coalesce if possible
  */
 void my_free(void *bp)
 {
     size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, prev_alloc)); /* mark header as free */
+    PUT(FTRP(bp), PACK(size, prev_alloc)); /* free blocks get a footer */
+    stats.allocated_bytes -= size;
+    stats.frees++;
+    stat_add_free(size);
+    bp = coalesce(bp);            /* merge with adjacent free blocks if any */
+
+    /* Top block: give the tail back to the OS */
+    if (GET_SIZE(HDRP(NXT_BLOCK(bp))) == 0 && GET_SIZE(HDRP(bp)) >= TRIM_THRESHOLD)
+        heap_trim(bp);
+
+    dirty_bytes += size;
+    if (dirty_bytes >= RELEASE_THRESHOLD)
+        release_pages();
+}
+
+/*
+ * my_heap_growth - set the growth policy: each commit grows the heap by its
+ * current committed size, but by at least 'min' and at most 'max' bytes
+ * (then rounded up to whole pages). min == max gives fixed steps, and 0
+ * for either bound restores its default (GROW_MIN, GROW_MAX).
+ * Returns 0, or -1 if min > max once the defaults are filled in.
+ */
+int my_heap_growth(size_t min, size_t max)
+{
+    min = min ? min : GROW_MIN;
+    max = max ? max : GROW_MAX;
+    if (min > max)
+        return -1;
+    grow_min = min;
+    grow_max = max;
+    return 0;
+}
+
+/*
+ * my_malloc_stats - snapshot of the heap usage counters (mallinfo style)
+ * O(1) unless the largest free block was allocated or trimmed and no free
+ * block since then was as big as all the others. Then the new largest
+ * block is searched for: a heap walk, O(blocks), or with FIT_INDEX a walk
+ * of the free blocks in regions whose bound could hold it.
+ */
+malloc_stats_t my_malloc_stats(void)
+{
+    if (heap_list_p == 0)
+        return (malloc_stats_t){0};
+
+    if (largest_stale)
+    {
+        stats.largest_searches++;
+#ifdef FIT_INDEX
+        stats.largest_free = idx_largest();
+        other_free_bound = stats.largest_free;
+#else
+        /* Keep the runner-up too: it is the exact bound on the others */
+        stats.largest_free = other_free_bound = 0;
+        for (char *bp = heap_list_p; GET_SIZE(HDRP(bp)) > 0; bp = NXT_BLOCK(bp))
+        {
+            size_t size = GET_SIZE(HDRP(bp));
+            if (GET_ALLOC(HDRP(bp)) || size <= other_free_bound)
+                continue;
+            other_free_bound = MIN(size, stats.largest_free);
+            stats.largest_free = MAX(size, stats.largest_free);
+        }
+#endif
+        largest_stale = 0;
+    }
 
-    PUT(HDRP(bp), PACK(size, 0)); /* mark header as free */
-    PUT(FTRP(bp), PACK(size, 0)); /* mark footer as free */
-    coalesce(bp);                 /* merge with adjacent free blocks if any */
+    malloc_stats_t snap = stats;
+    snap.heap_bytes = heap_hi - heap_lo;
+    snap.committed_bytes = heap_committed - heap_lo;
+    return snap;
 }
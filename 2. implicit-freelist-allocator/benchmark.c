@@ -1,3 +1,11 @@
+/*
+ * Random alloc/free churn benchmark.
+ *
+ * First fit vs. next fit, with and without the bitmap index:
+ *   gcc -O2 benchmark.c -o bench               (first fit from the heap start)
+ *   gcc -O2 -DNEXT_FIT benchmark.c -o bench    (next fit from the rover)
+ *   gcc -O2 -DFIT_INDEX benchmark.c -o bench   (first fit over free blocks only)
+ */
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -12,6 +20,20 @@
 void *pointers[NUM_OPS];
 int ptr_status[NUM_OPS]; // 0 = free, 1 = allocated
 
+// Resident set size in KB, from /proc/self/statm
+long rss_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
 int main()
 {
     printf("Starting Benchmark...\n");
@@ -89,5 +111,38 @@ int main()
     printf("Throughput: %.0f ops/sec\n", NUM_OPS / time_spent);
     printf("--------------------------------------------\n");
 
+    // What a metrics scraper sees, and what reading it costs
+    malloc_stats_t st = my_malloc_stats();
+    printf("Heap: %zu KB, allocated %zu KB, free %zu KB in %zu blocks (largest %zu bytes)\n",
+           st.heap_bytes / 1024, st.allocated_bytes / 1024, st.free_bytes / 1024, st.free_blocks, st.largest_free);
+    printf("Fit search: %.1f blocks examined per malloc\n", (double)st.search_steps / st.mallocs);
+    printf("Heap growth: %zu extend_heap calls, %zu mprotect commits\n", st.heap_grows, st.heap_commits);
+    struct timespec t0, t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < 1000000; i++)
+        st = my_malloc_stats();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    largest_stale = 1; // as if the largest free block was just allocated
+    st = my_malloc_stats();
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    printf("my_malloc_stats: %.1f ns (counters), %.1f us (largest block recomputed)\n",
+           ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e6,
+           ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec)) / 1e3);
+    printf("--------------------------------------------\n");
+
+    // Free everything still live and see how much memory goes back to the OS
+    long rss_live = rss_kb();
+    for (int i = 0; i < NUM_OPS; i++)
+    {
+        if (ptr_status[i] == 1)
+        {
+            my_free(pointers[i]);
+            ptr_status[i] = 0;
+        }
+    }
+    printf("RSS with live blocks: %ld KB\n", rss_live);
+    printf("RSS after freeing all: %ld KB\n", rss_kb());
+    printf("--------------------------------------------\n");
+
     return 0;
 }
\ No newline at end of file
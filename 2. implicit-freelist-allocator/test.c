@@ -4,6 +4,20 @@
 #include <assert.h>
 #include "alloc.c"
 
+// Large enough to move the heap end by more than one commit granule
+#ifdef HUGEPAGES
+#define BIG_BLOCK (2 * HUGE_PAGE_SIZE)
+#else
+#define BIG_BLOCK (TRIM_THRESHOLD * 2)
+#endif
+
+// Allocated blocks find_fit reads on its way to a fit: the index skips them
+#ifdef FIT_INDEX
+#define SCANNED(n) 0
+#else
+#define SCANNED(n) (n)
+#endif
+
 #define ANSI_COLOR_RED "\x1b[31m"
 #define ANSI_COLOR_GREEN "\x1b[32m"
 #define ANSI_COLOR_RESET "\x1b[0m"
@@ -53,25 +67,43 @@ int check_heap_integrity()
             return 0;
         }
 
-        // Check 2: Boundary consistency (Header == Footer)
-        if (GET(HDRP(bp)) != GET(FTRP(bp)))
+        // Check 2: Boundary consistency (Header == Footer, free blocks only)
+        int is_alloc = GET_ALLOC(HDRP(bp));
+        if (!is_alloc && GET(HDRP(bp)) != GET(FTRP(bp)))
         {
             printf("ERROR: Header/Footer mismatch at %p\n", bp);
             return 0;
         }
 
-        // Check 3: Coalescing Invariant (No two free blocks in a row)
-        int is_alloc = GET_ALLOC(HDRP(bp));
+        // Check 3: PREV_ALLOC matches the previous block (the prologue has no predecessor)
+        if (bp != heap_list_p && !GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
+        {
+            printf("ERROR: Stale PREV_ALLOC bit at %p\n", bp);
+            return 0;
+        }
+
+        // Check 4: Coalescing Invariant (No two free blocks in a row)
         if (!prev_alloc && !is_alloc)
         {
             printf("ERROR: Escaped Coalescing at %p. Two consecutive free blocks.\n", bp);
             return 0;
         }
+
+#ifdef FIT_INDEX
+        // Check 5: Exactly the free blocks are indexed, under their region's bound
+        size_t g = (bp - heap_lo) / DWORD;
+        int indexed = (idx->l0[g / 64] >> (g % 64)) & 1;
+        if (indexed != !is_alloc || (indexed && GET_SIZE(HDRP(bp)) > idx->max[g / IDX_REGION_GRANULES]))
+        {
+            printf("ERROR: Index out of date at %p\n", bp);
+            return 0;
+        }
+#endif
         prev_alloc = is_alloc;
     }
 
     // Check Epilogue
-    if (GET_SIZE(HDRP(bp)) != 0 || !GET_ALLOC(HDRP(bp)))
+    if (GET_SIZE(HDRP(bp)) != 0 || !GET_ALLOC(HDRP(bp)) || !GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
     {
         printf("ERROR: Bad Epilogue\n");
         return 0;
@@ -95,15 +127,15 @@ void test_basic_malloc()
 {
     printf("\n=== Test 2: Basic Allocation & Alignment ===\n");
 
-    // Alloc 1 byte (Should round up to 32 bytes total block size)
+    // Alloc 1 byte (Should round up to the minimum block size)
     char *p1 = my_malloc(1);
     TEST_ASSERT(p1 != NULL, "Malloc returned a pointer");
     TEST_ASSERT((uintptr_t)p1 % 16 == 0, "Pointer is 16-byte aligned");
 
     // White-box: Check internal block size
-    // Payload 16 + Header 8 + Footer 8 = 32
+    // Header + Payload (room for the footer once free) = MIN_BLOCK (32, or 16 with COMPACT_TAGS)
     size_t block_size = GET_SIZE(HDRP(p1));
-    TEST_ASSERT(block_size == 32, "Block size rounded up correctly (min block size)");
+    TEST_ASSERT(block_size == MIN_BLOCK, "Block size rounded up correctly (min block size)");
 
     // Write data to verify safety
     *p1 = 'A';
@@ -131,6 +163,9 @@ void test_coalescing()
     // Alloc a block larger than one of them, but smaller than the sum
     // P1 (80 bytes w/ overhead) + P2 (80 bytes w/ overhead) = 160 bytes total available
     // Request 100 bytes payload
+#ifdef NEXT_FIT
+    rover = heap_list_p; // search from the front, as first fit does
+#endif
     char *p4 = my_malloc(100);
 
     // If coalescing worked, p4 should start exactly where p1 was
@@ -159,6 +194,345 @@ void test_fragmentation_splitting()
     my_free(p_small);
 }
 
+#ifdef HUGEPAGES
+// Whether the mapping holding addr carries VmFlag 'flag' in /proc/self/smaps
+int has_vmflag(char *addr, const char *flag)
+{
+    char line[512];
+    int inside = 0, found = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        uintptr_t start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+            inside = start <= (uintptr_t)addr && (uintptr_t)addr < end;
+        else if (inside && strncmp(line, "VmFlags:", 8) == 0)
+        {
+            char *tok = strtok(line + 8, " \n");
+            for (; tok != NULL && !found; tok = strtok(NULL, " \n"))
+                found = strcmp(tok, flag) == 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+#endif
+
+void test_heap_trim()
+{
+    printf("\n=== Test 5: Heap Trimming ===\n");
+
+    char *big = my_malloc(BIG_BLOCK);
+    char *grown_end = heap_committed;
+
+    my_free(big);
+    TEST_ASSERT(heap_committed < grown_end, "Heap tail decommitted after freeing the top block");
+    TEST_ASSERT(heap_hi == heap_committed, "Heap ends on the last committed page");
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent after trim");
+
+    char *again = my_malloc(BIG_BLOCK);
+    TEST_ASSERT(again == big, "Heap regrows over the trimmed range");
+#ifdef HUGEPAGES
+    // The trim's PROT_NONE remap drops MADV_HUGEPAGE; the recommit must advise again
+    TEST_ASSERT(has_vmflag(again + BIG_BLOCK - 1, "hg") == has_vmflag(heap_lo, "hg"), "Regrown range keeps the huge page advice");
+#endif
+    my_free(again);
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent after regrowth");
+}
+
+// Largest free block, by a heap walk
+size_t walk_largest_free()
+{
+    size_t largest = 0;
+    for (char *bp = heap_list_p; GET_SIZE(HDRP(bp)) > 0; bp = NXT_BLOCK(bp))
+        if (!GET_ALLOC(HDRP(bp)))
+            largest = MAX(largest, GET_SIZE(HDRP(bp)));
+    return largest;
+}
+
+void test_stats()
+{
+    printf("\n=== Test 6: Incremental Statistics ===\n");
+    mminit();
+    void *live[64] = {0};
+    int matched = 1;
+    srand(3);
+
+    malloc_stats_t st = my_malloc_stats();
+    TEST_ASSERT(st.free_blocks == 1 && st.largest_free == CHUNKSIZE && st.allocated_bytes == 0, "Fresh heap: one free chunk");
+
+    // Splitting the top block leaves a remainder bigger than the hole: still the exact largest
+    char *a = my_malloc(100), *b = my_malloc(100), *c = my_malloc(100);
+    my_free(b);
+    char *d = my_malloc(500);
+    st = my_malloc_stats();
+    TEST_ASSERT(st.largest_free == walk_largest_free() && st.largest_searches == 0, "Largest kept across splits without a search");
+    my_free(a);
+    my_free(c);
+    my_free(d);
+    st = my_malloc_stats();
+    TEST_ASSERT(st.largest_free == walk_largest_free() && st.largest_searches == 0, "Merges into the top block need no search");
+
+    // Random churn, comparing the counters with a heap walk after every step
+    for (int i = 0; i < 2000 && matched; i++)
+    {
+        int k = rand() % 64;
+        if (live[k])
+        {
+            my_free(live[k]);
+            live[k] = NULL;
+        }
+        else
+        {
+            live[k] = my_malloc(1 + rand() % (k < 4 ? BIG_BLOCK : 500));
+        }
+
+        size_t alloc_bytes = 0, free_bytes = 0, free_blocks = 0, largest = 0;
+        for (char *bp = heap_list_p; GET_SIZE(HDRP(bp)) > 0; bp = NXT_BLOCK(bp))
+        {
+            if (bp == heap_list_p)
+                continue; // prologue
+            size_t size = GET_SIZE(HDRP(bp));
+            if (GET_ALLOC(HDRP(bp)))
+            {
+                alloc_bytes += size;
+            }
+            else
+            {
+                free_bytes += size;
+                free_blocks++;
+                largest = MAX(largest, size);
+            }
+        }
+        st = my_malloc_stats();
+        matched = st.allocated_bytes == alloc_bytes && st.free_bytes == free_bytes &&
+                  st.free_blocks == free_blocks && st.largest_free == largest &&
+                  st.heap_bytes == (size_t)(heap_hi - heap_lo) &&
+                  st.heap_bytes == DWORD + alloc_bytes + free_bytes + DWORD;
+    }
+    TEST_ASSERT(matched, "Counters match a full heap walk throughout");
+    printf("  %zu of 2000 reads searched for the largest block\n", st.largest_searches);
+    TEST_ASSERT(st.largest_searches < 200, "Most reads keep the largest without a search");
+    size_t nlive = 0;
+    for (int k = 0; k < 64; k++)
+        nlive += (live[k] != NULL);
+    TEST_ASSERT(st.mallocs - st.frees == nlive, "Operation counts match live blocks");
+    TEST_ASSERT(st.heap_grows > 1 && st.heap_trims > 0, "Growth and trims counted");
+
+    for (int k = 0; k < 64; k++)
+        if (live[k])
+            my_free(live[k]);
+    st = my_malloc_stats();
+    TEST_ASSERT(st.allocated_bytes == 0 && st.free_blocks == 1 && st.mallocs == st.frees, "Everything free again: one block");
+    TEST_ASSERT(st.largest_free == st.free_bytes, "Largest free block is the whole free space");
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent after churn");
+}
+
+void test_find_fit()
+{
+    printf("\n=== Test 7: Fit Search ===\n");
+    mminit();
+
+    char *a = my_malloc(64);
+    char *b = my_malloc(64);
+    char *c = my_malloc(64);
+    char *d = my_malloc(64);
+    my_free(a);
+    my_free(c);
+
+    size_t steps = my_malloc_stats().search_steps;
+    char *e = my_malloc(64);
+#ifdef NEXT_FIT
+    // The last search stopped at d: the holes behind it are not revisited
+    TEST_ASSERT(e == d + GET_SIZE(HDRP(d)), "Next fit resumes after the last allocation");
+    TEST_ASSERT(my_malloc_stats().search_steps - steps == 1 + SCANNED(1), "Nothing behind d examined");
+
+    // Point the rover at c, then free b: a, b and c merge and the rover follows
+    my_free(e);
+    rover = c;
+    my_free(b);
+    TEST_ASSERT(rover == a && GET_SIZE(HDRP(a)) == 3 * GET_SIZE(HDRP(d)), "Rover moved to the start of the merged block");
+    char *f = my_malloc(200);
+    TEST_ASSERT(f == a, "Search from the fixed-up rover finds the merged block");
+    my_free(f);
+#else
+    // First fit restarts at the front: the prologue and a
+    TEST_ASSERT(e == a, "First fit takes the lowest hole");
+    TEST_ASSERT(my_malloc_stats().search_steps - steps == 1 + SCANNED(1), "Search stopped at a");
+    my_free(e);
+    my_free(b);
+#endif
+    my_free(d);
+    TEST_ASSERT(my_malloc_stats().free_blocks == 1, "Everything merged again");
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent after searches");
+}
+
+void test_footer_elision()
+{
+    printf("\n=== Test 8: Footer Elision ===\n");
+    mminit();
+
+    char *p = my_malloc(24);
+    char *q = my_malloc(24);
+    TEST_ASSERT(GET_SIZE(HDRP(p)) == 2 * DWORD, "24-byte request fits a 32-byte block");
+    TEST_ASSERT(q == p + 2 * DWORD && GET_PREV_ALLOC(HDRP(q)), "Neighbour knows its predecessor is allocated");
+
+    // The payload runs up to the next header
+    memset(p, 0x5A, 24);
+    TEST_ASSERT(GET_SIZE(HDRP(q)) == 2 * DWORD && GET_ALLOC(HDRP(q)), "Full payload write leaves the next header intact");
+
+    my_free(p);
+    TEST_ASSERT(!GET_PREV_ALLOC(HDRP(q)) && GET(FTRP(p)) == GET(HDRP(p)), "Free block has a footer, neighbour's bit cleared");
+#ifdef NEXT_FIT
+    rover = heap_list_p;
+#endif
+    TEST_ASSERT(my_malloc(24) == p && GET_PREV_ALLOC(HDRP(q)), "Reallocation sets the bit again");
+
+    my_free(q);
+    my_free(p);
+    TEST_ASSERT(my_malloc_stats().free_blocks == 1, "Everything merged again");
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent");
+}
+
+#ifdef FIT_INDEX
+void test_fit_index()
+{
+    printf("\n=== Test 9: Fit Index ===\n");
+    mminit();
+
+    // 2048 64-byte blocks span two 64 KB regions
+    static char *blocks[2048];
+    for (int i = 0; i < 2048; i++)
+        blocks[i] = my_malloc(48);
+    TEST_ASSERT(GET_SIZE(HDRP(blocks[0])) == 64, "48-byte request fits a 64-byte block");
+
+    // 128 small holes and a 41-block hole in the first region, another 41-block hole in the second
+    for (int i = 0; i < 256; i += 2)
+        my_free(blocks[i]);
+    for (int i = 300; i <= 340; i++)
+        my_free(blocks[i]);
+    for (int i = 1500; i <= 1540; i++)
+        my_free(blocks[i]);
+    TEST_ASSERT(check_heap_integrity(), "Index matches the heap after frees");
+
+#ifdef NEXT_FIT
+    rover = heap_list_p;
+#endif
+    size_t steps = my_malloc_stats().search_steps;
+    char *p = my_malloc(2000);
+    TEST_ASSERT(p == blocks[300], "First hole that fits is taken");
+    TEST_ASSERT(my_malloc_stats().search_steps - steps == 128 + 1, "Only free blocks examined");
+
+    // The first region's bound is stale now: one full scan tightens it
+#ifdef NEXT_FIT
+    rover = heap_list_p;
+#endif
+    steps = my_malloc_stats().search_steps;
+    char *q = my_malloc(2000);
+    TEST_ASSERT(q == blocks[1500], "Next large request lands in the second region");
+    TEST_ASSERT(my_malloc_stats().search_steps - steps == 128 + 1 + 1, "First region scanned once");
+
+    my_free(q);
+#ifdef NEXT_FIT
+    rover = heap_list_p;
+#endif
+    steps = my_malloc_stats().search_steps;
+    q = my_malloc(2000);
+    TEST_ASSERT(q == blocks[1500], "Same block found again");
+    TEST_ASSERT(my_malloc_stats().search_steps - steps == 1, "First region skipped by its bound");
+
+    my_free(p);
+    my_free(q);
+    for (int i = 0; i < 2048; i++)
+        if ((i % 2 && i < 256) || (i >= 256 && i < 300) || (i > 340 && i < 1500) || i > 1540)
+            my_free(blocks[i]);
+    TEST_ASSERT(my_malloc_stats().free_blocks == 1, "Everything merged again");
+    TEST_ASSERT(check_heap_integrity(), "Index consistent after merges");
+}
+#endif
+
+// Commits needed to grow a fresh heap to 4 MB in 1 KB blocks; the blocks are freed again
+size_t commits_to_grow(void **blocks)
+{
+    mminit();
+    size_t before = my_malloc_stats().heap_commits;
+    for (int i = 0; i < 4096; i++)
+        blocks[i] = my_malloc(1000);
+    size_t commits = my_malloc_stats().heap_commits - before;
+    for (int i = 4095; i >= 0; i--)
+        my_free(blocks[i]);
+    return commits;
+}
+
+void test_heap_growth()
+{
+    printf("\n=== Test 11: Heap Growth Policy ===\n");
+    static void *blocks[4096];
+
+    TEST_ASSERT(my_heap_growth(2 * CHUNKSIZE, CHUNKSIZE) == -1, "min above max rejected");
+
+    // Fixed page-sized steps, as before the policy
+    my_heap_growth(CHUNKSIZE, CHUNKSIZE);
+    size_t fixed = commits_to_grow(blocks);
+
+    // 0 restores each bound's default, the same policy as passing them
+    TEST_ASSERT(my_heap_growth(0, 0) == 0 && grow_min == GROW_MIN && grow_max == GROW_MAX, "0, 0 restores the defaults");
+    TEST_ASSERT(my_heap_growth(CHUNKSIZE, 0) == 0 && grow_min == CHUNKSIZE && grow_max == GROW_MAX, "0 max keeps its default");
+    TEST_ASSERT(my_heap_growth(2 * (size_t)GROW_MAX, 0) == -1, "min above the default max rejected");
+    my_heap_growth(0, 0);
+    size_t geometric = commits_to_grow(blocks);
+#ifndef HUGEPAGES
+    // 4 KB doubling to the 1 MB cap, then 1 MB steps: about 12 commits instead of ~1000
+    TEST_ASSERT(fixed > 900 && geometric < 16, "Geometric growth cuts commits");
+#else
+    TEST_ASSERT(geometric <= fixed, "Huge-page steps are never split");
+#endif
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent after growth and trim");
+
+    // The trim above shrank the heap: the next step is small again
+    malloc_stats_t st = my_malloc_stats();
+    TEST_ASSERT(st.committed_bytes <= MAX((size_t)TRIM_THRESHOLD, CORE_GRANULE), "Trim dropped the committed tail");
+    size_t old_committed = st.committed_bytes;
+    void *p = my_malloc(st.committed_bytes);
+    st = my_malloc_stats();
+    TEST_ASSERT(p != NULL && st.committed_bytes - old_committed <= MAX(2 * old_committed, CORE_GRANULE),
+                "Step after a trim follows the smaller heap");
+    TEST_ASSERT(st.committed_bytes - st.heap_bytes <= MAX((size_t)GROW_MAX, CORE_GRANULE), "Commit-ahead stays under the cap");
+    my_free(p);
+}
+
+#ifdef COMPACT_TAGS
+void test_compact_tags()
+{
+    printf("\n=== Test 10: Compact Tags ===\n");
+    mminit();
+
+    // 4-byte header: 12 bytes of payload fit the 16-byte minimum block
+    char *p = my_malloc(12);
+    char *q = my_malloc(12);
+    TEST_ASSERT(GET_SIZE(HDRP(p)) == 16 && q == p + 16, "12-byte requests take 16-byte blocks");
+    memset(p, 0x5A, 12);
+    TEST_ASSERT(GET_SIZE(HDRP(q)) == 16 && GET_ALLOC(HDRP(q)), "Full payload write leaves the next header intact");
+
+    // 28 bytes + 4-byte header = 32; 8-byte tags need 48
+    char *r = my_malloc(28);
+    TEST_ASSERT(GET_SIZE(HDRP(r)) == 32, "28-byte request fits a 32-byte block");
+
+    // A freed minimum block still holds its header and footer
+    my_free(p);
+    TEST_ASSERT(GET(FTRP(p)) == GET(HDRP(p)) && !GET_PREV_ALLOC(HDRP(q)), "Free 16-byte block has a footer");
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent with a free minimum block");
+
+    my_free(r);
+    my_free(q);
+    TEST_ASSERT(my_malloc_stats().free_blocks == 1, "Everything merged again");
+    TEST_ASSERT(check_heap_integrity(), "Heap consistent");
+}
+#endif
+
 int main()
 {
     printf("Starting Malloc Unit Tests...\n");
@@ -167,6 +541,17 @@ int main()
     test_basic_malloc();
     test_coalescing();
     test_fragmentation_splitting();
+    test_heap_trim();
+    test_stats();
+    test_find_fit();
+    test_footer_elision();
+#ifdef FIT_INDEX
+    test_fit_index();
+#endif
+#ifdef COMPACT_TAGS
+    test_compact_tags();
+#endif
+    test_heap_growth();
 
     printf("\n------------------------------------------------\n");
     printf("Summary: %d / %d Tests Passed.\n", tests_passed, tests_total);
@@ -12,71 +12,375 @@
  * for a 32-bit machine (WORD = 4, DWORD = 8).
  *
  * Layout of a block:
- *    [ header | payload... | footer ]
+ *    allocated: [ header | payload... ]
+ *    free:      [ header | prev | next | ... | footer ]
+ *
+ * Only free blocks have a footer. Each header carries a PREV_ALLOC flag
+ * saying whether the block before it is allocated, which is all that
+ * coalescing needs to know, so an allocated block's payload runs up to
+ * the next header.
  *
  * Prologue block: allocated block of size DWORD to make edge conditions simpler.
  * Epilogue header: zero-size allocated block at the end of the heap.
+ *
+ * Free blocks are kept in segregated lists, one per size class: exact
+ * DWORD-step classes up to SMALL_CLASS_MAX, then power-of-two ranges.
+ * A request only scans its own class and the classes above it.
+ *
+ * Heaps: the program break is never touched. Each heap is HEAP_SIZE bytes
+ * of address space reserved PROT_NONE at a HEAP_SIZE-aligned address, with
+ * a heap_t at its base; pages are committed with mprotect as the heap grows
+ * and the heap has its own prologue and epilogue. An arena that fills its
+ * top heap continues in a fresh one, and the heap_t (hence the owning
+ * arena) of any block is found by masking its address.
+ *
+ * Arenas: class lists and lock live in an arena_t. The main arena is a
+ * static; every other arena_t sits right after the heap_t of its first
+ * heap. Threads are spread over arenas round-robin and move on when they
+ * find their arena's lock taken. Small frees and the matching mallocs are
+ * served lock-free from a per-thread cache.
+ * A block freed by a thread that is not using its arena is pushed onto
+ * the arena's lock-free remote-free stack instead, and the arena drains
+ * it in batches under its own lock, so cross-thread frees never block.
+ * With my_mallopt(M_SMALL_PAGES, n), requests up to n bytes are served
+ * from per-size pages with their own free lists (see page_malloc), so
+ * consecutive small allocations sit next to each other.
+ *
+ * Requests of mmap_threshold bytes or more skip the arenas entirely and
+ * get a private mapping, tagged MMAPPED in the header, that my_free unmaps
+ * and my_realloc resizes with mremap.
+ * my_calloc only clears memory that is not known to be zero: blocks cut
+ * from fresh heap pages carry a ZEROED tag until they are first handed out.
+ * With my_mallopt(M_MXFAST, n), small frees that reach an arena are parked
+ * in exact-size fast bins without coalescing, and coalesced in bulk when
+ * a large request or heap growth needs the space.
+ * my_mallopt(M_PROFILE_INTERVAL, bytes) turns on a sampling heap profiler:
+ * about one allocation per 'bytes' allocated is backtraced and tracked
+ * until freed, and my_heap_profile_dump writes a pprof heap profile.
+ * Freed memory flows back to the OS too: a top free block larger than
+ * trim_threshold shrinks the heap, and every release_threshold bytes of
+ * frees the whole pages inside large free blocks are madvise'd away.
+ * Heaps commit pages geometrically: each mprotect grows a heap by its
+ * committed size, clamped to a per-heap [min, max] (my_heap_growth, with
+ * defaults from my_mallopt(M_GROW_MIN / M_GROW_MAX)), so ramping up to
+ * gigabytes takes a few thousand calls instead of one per page. A trim
+ * shrinks the heap and so the next step; my_heap_commits counts the calls.
+ * my_mallopt(M_HUGEPAGES, 1) makes heaps commit, trim and release in 2 MB
+ * steps and asks for transparent huge pages with MADV_HUGEPAGE, cutting
+ * dTLB misses on big heaps; without THP support the advice is ignored.
+ *
+ * Built with -DCOMPACT_TAGS, headers and footers are 32-bit words and
+ * free-list links are 32-bit offsets from the base of one 4 GB zone that
+ * every heap is carved from, so the minimum block is 16 bytes instead of
+ * 32. All heaps together, and every mapped block, must then fit in 4 GB.
+ *
+ * mminit resets the main arena and must not race with other threads.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* mremap; files that include this one must define it before any header */
+#endif
 #include <unistd.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 
+#ifdef COMPACT_TAGS
+#define WORD 4                          /* header, footer and free-list link size */
+typedef uint32_t tag_t;
+#else
 #define WORD 8
+typedef uintptr_t tag_t;
+#endif
 #define DWORD 16
+#define MIN_BLOCK (4 * WORD)            /* header, two links and footer, once free */
 #define CHUNKSIZE (1 << 12)
 
-#define GET(p) (*(uintptr_t *)(p))
-#define PUT(p, val) (*(uintptr_t *)(p) = (val))
+/* Size classes: MIN_BLOCK, +16, ..., 512 exactly, then (512, 1K], (1K, 2K], ... */
+#define SMALL_CLASS_MAX 512
+#define NUM_SMALL_CLASSES ((SMALL_CLASS_MAX - MIN_BLOCK) / DWORD + 1)
+#ifndef NUM_CLASSES
+#define NUM_CLASSES (NUM_SMALL_CLASSES + 24) /* build with -DNUM_CLASSES=1 for a single list */
+#endif
+
+#define GET(p) (*(tag_t *)(p))
+#define PUT(p, val) (*(tag_t *)(p) = (tag_t)(val))
 
 #define PACK(size, alloc) ((size) | (alloc))
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
 #define GET_SIZE(p) (GET(p) & ~(DWORD - 1))
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define GET_MMAPPED(p) IS_MMAPPED(GET(p))
+#define GET_ZEROED(p) (GET(p) & ZEROED)
+
+/* Header flag of heap blocks and epilogues: the block before this one is allocated */
+#define PREV_ALLOC 0x2
+/*
+ * Free-block flag (header and footer): every payload byte past the two
+ * free-list link words is still zero from the OS. Any rewrite of the tags
+ * that leaves it out conservatively drops it.
+ */
+#define ZEROED 0x4
+/* Allocated-block flag (header only): the heap profiler holds a sample for this block */
+#define SAMPLED 0x8
+/* Allocated-block flag (header only): object inside a small-object page. Free blocks use this bit as ZEROED */
+#define PAGED 0x4
+/*
+ * Allocated-block flags (header only): block is its own mmap region,
+ * outside every arena. Page objects and mapped blocks have no neighbours
+ * to coalesce with, so they never set PREV_ALLOC; with the alloc bit,
+ * 0x2 and 0x4 tell the three kinds of allocated block apart.
+ */
+#define MMAPPED (PREV_ALLOC | PAGED)
+#define IS_MMAPPED(hdr) (((hdr) & (MMAPPED | 1)) == (MMAPPED | 1))
+#define IS_PAGED(hdr) (((hdr) & (MMAPPED | 1)) == (PAGED | 1))
 
 #define HDRP(bp) ((char *)(bp) - WORD)
-#define FTRP(bp) (((char *)(bp) + GET_SIZE(HDRP(bp))) - DWORD)
+#define FTRP(bp) (((char *)(bp) + GET_SIZE(HDRP(bp))) - 2 * WORD)
 
 #define NXT_BLOCK(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
-#define PRV_BLOCK(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - DWORD))
+#define PRV_BLOCK(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - 2 * WORD)) /* previous block must be free */
+
+/*
+ * An allocated block's owner reads its header without the arena lock,
+ * while neighbours flip its PREV_ALLOC flag under the lock: both sides use
+ * relaxed atomic accesses. Lock-free readers never look at the flag.
+ */
+#define GET_SHARED(p) __atomic_load_n((tag_t *)(p), __ATOMIC_RELAXED)
+#define PUT_SHARED(p, val) __atomic_store_n((tag_t *)(p), (tag_t)(val), __ATOMIC_RELAXED)
 
+/* Set or clear the PREV_ALLOC flag in block bp's header (caller holds the arena lock) */
+#define SET_PREV_ALLOC(bp) PUT_SHARED(HDRP(bp), GET(HDRP(bp)) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(bp) PUT_SHARED(HDRP(bp), GET(HDRP(bp)) & ~(tag_t)PREV_ALLOC)
+
+#ifdef COMPACT_TAGS
+/* Free list node stores zone offsets at bp (prev) and bp+WORD (next); offset 0 (the first heap_t) is NULL */
+#define ZONE_SIZE (4UL << 30)           /* address space every heap is carved from */
+#define LINK_PTR(off) ((off) ? zone_base + (off) : NULL)
+#define LINK_OFF(p) ((p) ? (uint32_t)((char *)(p) - zone_base) : 0)
+#define GET_NXT_PTR(bp) LINK_PTR(*(uint32_t *)((char *)(bp) + WORD))
+#define GET_PRV_PTR(bp) LINK_PTR(*(uint32_t *)(bp))
+#define SET_NXT_PTR(bp, p) (*(uint32_t *)((char *)(bp) + WORD) = LINK_OFF(p))
+#define SET_PRV_PTR(bp, p) (*(uint32_t *)(bp) = LINK_OFF(p))
+#else
 /* Free list node stores pointers at bp (prev) and bp+WORD (next) */
-#define GET_NXT_PTR(bp) (*(char **)(bp + WORD))
+#define GET_NXT_PTR(bp) (*(char **)((char *)(bp) + WORD))
 #define GET_PRV_PTR(bp) (*(char **)(bp))
+#define SET_NXT_PTR(bp, p) (GET_NXT_PTR(bp) = (p))
+#define SET_PRV_PTR(bp, p) (GET_PRV_PTR(bp) = (p))
+#endif
+
+/* Thread cache: one bin per block size from MIN_BLOCK in DWORD steps */
+#define TCACHE_MAX_BINS 64
+#define TCACHE_COUNT 7       /* default bin depth */
+#define TCACHE_COUNT_MAX 255 /* upper bound accepted by my_mallopt */
+#define TCACHE_BIN(asize) ((int)(((asize) - MIN_BLOCK) / DWORD))
+/* Cached blocks are singly linked through their first payload word */
+#define TC_NEXT(bp) (*(char **)(bp))
+
+/* Fast bins: per-arena, exact-size, deferred-coalescing lists for small blocks */
+#define MXFAST_MAX 160                 /* largest request my_mallopt(M_MXFAST) accepts */
+#define FASTBIN_INDEX(asize) ((int)(((asize) - MIN_BLOCK) / DWORD))
+#define NFASTBINS (FASTBIN_INDEX(MXFAST_MAX + DWORD) + 1) /* block sizes MIN_BLOCK .. 176 */
+#define FASTBIN_CONSOLIDATION_THRESHOLD (64 * 1024) /* freeing a block this big flushes the fast bins */
+/* Fast-bin blocks are singly linked through their first payload word */
+#define FB_NEXT(bp) (*(char **)(bp))
+
+/* Direct-mapped large blocks */
+#define MMAP_THRESHOLD (128 * 1024) /* default: requests this big bypass the arenas */
+/* Word before the header: distance from the start of the mapping to bp */
+#define MMAP_OFFSET(bp) GET((char *)(bp) - DWORD)
+
+/* Returning memory to the OS */
+#define TRIM_THRESHOLD (128 * 1024)    /* default: shrink the heap when its top free block exceeds this */
+#define TRIM_KEEP CHUNKSIZE            /* bytes left in the top block after a trim */
+#define RELEASE_THRESHOLD (1024 * 1024) /* default: bytes freed in an arena between madvise passes */
+#ifndef RELEASE_ADVICE
+#define RELEASE_ADVICE MADV_DONTNEED /* -DRELEASE_ADVICE=MADV_FREE for lazy reclaim */
+#endif
+
+/* Arenas */
+#define ARENA_MAX 64                     /* hard cap on the arena table */
+#define ARENAS_PER_CPU 4                 /* default limit: ARENAS_PER_CPU * online CPUs */
+#define ARENA_HDR_SIZE ((sizeof(arena_t) + DWORD - 1) & ~(size_t)(DWORD - 1))
+
+/* Heaps */
+#define HEAP_SIZE (64UL << 20)           /* address space reserved per heap; power of two */
+#define HUGE_PAGE_SIZE (2UL << 20)       /* heap growth granule with M_HUGEPAGES; divides HEAP_SIZE */
+#define GROW_MIN CHUNKSIZE               /* default: smallest commit step */
+#define GROW_MAX (1024 * 1024)           /* default: largest commit step */
+#define HEAP_HDR_SIZE ((sizeof(heap_t) + DWORD - 1) & ~(size_t)(DWORD - 1))
+
+/* my_mallopt parameters */
+#define M_TCACHE_COUNT 1
+#define M_ARENA_MAX 2
+#define M_MMAP_THRESHOLD 3
+#define M_TRIM_THRESHOLD 4
+#define M_RELEASE_THRESHOLD 5
+#define M_MXFAST 6
+#define M_PROFILE_INTERVAL 7
+#define M_HUGEPAGES 8
+#define M_REMOTE_FREE 9
+#define M_SMALL_PAGES 10
+#define M_GROW_MIN 11
+#define M_GROW_MAX 12
+
+/* Remote frees */
+#define REMOTE_DRAIN_BATCH 64           /* a pusher tries to drain once this many blocks wait */
+/* Remote-free blocks are linked through their first payload word */
+#define RF_NEXT(bp) (*(char **)(bp))
+
+/* Small-object pages */
+#define SPAGE_SIZE (64 * 1024)          /* bytes per page, aligned to its size; power of two */
+#define SPAGE_MAX 512                   /* largest request my_mallopt(M_SMALL_PAGES) accepts */
+#define SPAGE_CLASS(asize) ((int)(((asize) - MIN_BLOCK) / DWORD))
+#define NSPAGE_CLASSES (SPAGE_CLASS(SPAGE_MAX + DWORD) + 1) /* block sizes MIN_BLOCK .. 528, one page list each */
+#define SPAGE_HDR_SIZE ((sizeof(spage_t) + WORD + DWORD - 1) & ~(size_t)(DWORD - 1)) /* first object's bp */
+#define PAGE_FULL ((char *)1)           /* thread_free tag of a page unlinked for having no room */
+
+/* Sampling heap profiler */
+#define PROF_MAX_DEPTH 32               /* frames kept per sample */
+#define PROF_TABLE_SIZE (1 << 14)       /* sample slots; power of two */
+#define PROF_SKIP_FRAMES 8              /* room for allocator frames above the caller's */
+
+/*
+ * Functions that can be on the stack between a caller and prof_sample go
+ * in their own section; the profiler drops every frame inside it, so a
+ * sample is attributed to the caller whether or not the entry point was
+ * inlined into it, and through wrappers such as the LD_PRELOAD shim.
+ */
+#define ALLOC_TEXT __attribute__((section("alloc_text")))
+extern char __start_alloc_text[], __stop_alloc_text[];
+#define IN_ALLOC_TEXT(pc) ((char *)(pc) >= __start_alloc_text && (char *)(pc) < __stop_alloc_text)
+
+typedef struct tcache_t
+{
+    char *entries[TCACHE_MAX_BINS];
+    uint16_t counts[TCACHE_MAX_BINS];
+} tcache_t;
 
-static char *heap_list_p = 0;
-static char *free_list_p = 0;
+typedef struct heap_t
+{
+    struct arena_t *ar;             /* owning arena */
+    struct heap_t *prev;            /* the arena's previous (full) heap */
+    char *hi;                       /* end of the block area: just past the epilogue header */
+    char *committed;                /* [heap, committed) is read/write, the rest PROT_NONE */
+    size_t grow_min;                /* commit step bounds, see my_heap_growth; 0 = my_mallopt default */
+    size_t grow_max;
+    size_t commits;                 /* mprotect calls that grew the heap */
+} heap_t;
+
+typedef struct spage_t
+{
+    char *free;                     /* local free list; guarded by the arena lock */
+    _Atomic(char *) thread_free;    /* objects freed by threads not using the arena, or PAGE_FULL */
+    char *bump;                     /* next never-used object */
+    char *end;                      /* objects end by here */
+    struct spage_t *next;           /* arena's pages of this size with room */
+    struct spage_t *prev;
+    size_t asize;                   /* object block size */
+    size_t used;                    /* objects not on the local free list */
+    int full;                       /* unlinked: no room when last looked */
+} spage_t;
+
+typedef struct arena_t
+{
+    pthread_mutex_t lock;           /* guards everything below and every boundary tag in its heaps */
+    heap_t *top;                    /* heap that grows; NULL until the arena is initialized */
+    size_t dirty;                   /* bytes freed since the last madvise pass */
+    int have_fast;                  /* some fast bin is non-empty */
+    _Atomic(char *) remote;         /* lock-free stack of blocks freed by other threads */
+    atomic_size_t nremote;          /* blocks pushed since the last drain */
+    char *fastbins[NFASTBINS];
+    spage_t *spages[NSPAGE_CLASSES];
+    char *seg_lists[NUM_CLASSES];
+} arena_t;
+
+static arena_t main_arena = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static arena_t *arenas[ARENA_MAX] = {&main_arena};
+static int narenas = 1;
+static int arena_max = 0;           /* 0 until first use: then ARENAS_PER_CPU * CPUs */
+static unsigned arena_rr = 0;       /* round-robin assignment counter */
+static pthread_mutex_t arena_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread arena_t *thread_arena;
+static __thread tcache_t tcache;
+static __thread int tcache_registered;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static int tcache_count = TCACHE_COUNT;
+static size_t mmap_threshold = MMAP_THRESHOLD;
+static size_t trim_threshold = TRIM_THRESHOLD;
+static size_t release_threshold = RELEASE_THRESHOLD;
+static size_t fastbin_max = 0;      /* largest block size kept in fast bins; 0 = mode off */
+static int use_hugepages = 0;       /* grow heaps in HUGE_PAGE_SIZE steps and advise THP */
+static int remote_frees = 1;        /* frees from threads not using the block's arena go lock-free */
+static size_t spage_max = 0;        /* largest block size served from pages; 0 = mode off */
+static size_t grow_min = GROW_MIN;  /* commit step bounds of heaps without their own */
+static size_t grow_max = GROW_MAX;
+static atomic_size_t heap_commits;  /* mprotect calls that grew any heap */
+#ifdef COMPACT_TAGS
+static char *zone_base;             /* every heap lives in [zone_base, zone_base + ZONE_SIZE) */
+static char *zone_next;             /* first slot never handed out */
+static heap_t *zone_free;           /* released slots, linked through prev */
+static pthread_mutex_t zone_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Map a block size (including header/footer) to its segregated list index */
+static int get_class(size_t size)
+{
+    int cls;
+
+    if (size <= SMALL_CLASS_MAX)
+        cls = (int)((size - MIN_BLOCK) / DWORD);
+    else
+        /* floor(log2(size - 1)) is 9 for (512, 1K], 10 for (1K, 2K], ... */
+        cls = NUM_SMALL_CLASSES + (63 - __builtin_clzl(size - 1)) - 9;
+
+    return (cls < NUM_CLASSES) ? cls : NUM_CLASSES - 1;
+}
 
-/* Insert new free block at front of explicit free list (LIFO policy) */
-void insert_node(void *bp)
+/* Insert new free block at front of its class list (LIFO policy) */
+void insert_node(arena_t *ar, void *bp)
 {
-    GET_NXT_PTR(bp) = free_list_p;
-    GET_PRV_PTR(bp) = NULL;
+    char **root = &ar->seg_lists[get_class(GET_SIZE(HDRP(bp)))];
+
+    SET_NXT_PTR(bp, *root);
+    SET_PRV_PTR(bp, NULL);
 
-    if (free_list_p != NULL)
+    if (*root != NULL)
     {
-        GET_PRV_PTR(free_list_p) = bp;
+        SET_PRV_PTR(*root, bp);
     }
-    free_list_p = bp;
+    *root = bp;
 }
 
-/* Remove block from doubly-linked free list */
-void delete_node(void *bp)
+/* Remove block from its doubly-linked class list; header size must still be valid */
+void delete_node(arena_t *ar, void *bp)
 {
     if (GET_NXT_PTR(bp))
     {
-        GET_PRV_PTR(GET_NXT_PTR(bp)) = GET_PRV_PTR(bp);
+        SET_PRV_PTR(GET_NXT_PTR(bp), GET_PRV_PTR(bp));
     }
     if (GET_PRV_PTR(bp))
     {
-        GET_NXT_PTR(GET_PRV_PTR(bp)) = GET_NXT_PTR(bp);
+        SET_NXT_PTR(GET_PRV_PTR(bp), GET_NXT_PTR(bp));
     }
     else
     {
-        /* bp was the head of free list */
-        free_list_p = GET_NXT_PTR(bp);
+        /* bp was the head of its class list */
+        ar->seg_lists[get_class(GET_SIZE(HDRP(bp)))] = GET_NXT_PTR(bp);
     }
 }
 
@@ -88,103 +392,474 @@ void delete_node(void *bp)
  * 3) !prev_alloc && next_alloc : merge with previous
  * 4) !prev_alloc && !next_alloc : merge with both
  */
-static void *coalesce(void *bp)
+static void *coalesce(arena_t *ar, void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PRV_BLOCK(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NXT_BLOCK(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
+    /* A free block's predecessor is always allocated, so every merged header below gets PREV_ALLOC */
     if (prev_alloc && next_alloc)
     {
-        insert_node(bp);
+        insert_node(ar, bp);
     }
     else if (prev_alloc && !next_alloc)
     {
         /* Merge current block with free next block */
         size += GET_SIZE(HDRP(NXT_BLOCK(bp)));
-        delete_node(NXT_BLOCK(bp));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
-        insert_node(bp);
+        delete_node(ar, NXT_BLOCK(bp));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+        insert_node(ar, bp);
     }
     else if (!prev_alloc && next_alloc)
     {
         /* Merge current block with free previous block, update headers/footers */
-        size += GET_SIZE(FTRP(PRV_BLOCK(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, 0));
-        bp = PRV_BLOCK(bp);
+        char *prev = PRV_BLOCK(bp);
+        size_t prev_size = GET_SIZE(HDRP(prev));
+        /* Fresh heap growth landing on an untouched top block stays zero if the tags between them are wiped */
+        size_t zeroed = GET_ZEROED(HDRP(bp)) & GET_ZEROED(HDRP(prev));
+        int rebin;
+
+        size += prev_size;
+        rebin = get_class(prev_size) != get_class(size);
+        if (rebin)
+            delete_node(ar, prev);
+        PUT(FTRP(bp), PACK(size, PREV_ALLOC | zeroed));
+        PUT(HDRP(prev), PACK(size, PREV_ALLOC | zeroed));
+        if (zeroed)
+        {
+            PUT((char *)bp - 2 * WORD, 0);
+            PUT(HDRP(bp), 0);
+        }
+        bp = prev;
+        if (rebin)
+            insert_node(ar, bp);
     }
     else
     {
-        /* Merge with both neighbors; prev is already in free list, so don't re-insert */
-        size += GET_SIZE(FTRP(PRV_BLOCK(bp))) + GET_SIZE(HDRP(NXT_BLOCK(bp)));
-        delete_node(NXT_BLOCK(bp));
-        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, 0));
-        PUT(FTRP(NXT_BLOCK(bp)), PACK(size, 0));
-        bp = PRV_BLOCK(bp);
+        /* Merge with both neighbors; prev stays in place unless its class changes */
+        char *prev = PRV_BLOCK(bp);
+        size_t prev_size = GET_SIZE(HDRP(prev));
+        int rebin;
+
+        size += prev_size + GET_SIZE(HDRP(NXT_BLOCK(bp)));
+        rebin = get_class(prev_size) != get_class(size);
+        delete_node(ar, NXT_BLOCK(bp));
+        if (rebin)
+            delete_node(ar, prev);
+        PUT(HDRP(prev), PACK(size, PREV_ALLOC));
+        PUT(FTRP(NXT_BLOCK(bp)), PACK(size, PREV_ALLOC));
+        bp = prev;
+        if (rebin)
+            insert_node(ar, bp);
     }
+
+    /* The next block (allocated, or the epilogue) now follows a free block */
+    CLR_PREV_ALLOC(NXT_BLOCK(bp));
     return bp;
 }
 
+/*
+ * Round a size or address up/down to the system page size
+ * Any thread may fill the cached size first; each stores the same value,
+ * so relaxed atomics suffice.
+ */
+static size_t page_align(size_t size)
+{
+    static size_t page_size_cache;
+    size_t page_size = __atomic_load_n(&page_size_cache, __ATOMIC_RELAXED);
+
+    if (page_size == 0)
+    {
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+        __atomic_store_n(&page_size_cache, page_size, __ATOMIC_RELAXED);
+    }
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static char *page_floor(char *p)
+{
+    size_t page_size = page_align(1);
+    return (char *)((uintptr_t)p & ~(page_size - 1));
+}
+
+/* Unit heaps are committed, trimmed and released in: a page, or a huge page with M_HUGEPAGES */
+static size_t core_granule(void)
+{
+    return use_hugepages ? HUGE_PAGE_SIZE : page_align(1);
+}
+
+static char *core_ceil(char *p)
+{
+    size_t granule = core_granule();
+    return (char *)(((uintptr_t)p + granule - 1) & ~(granule - 1));
+}
+
+static char *core_floor(char *p)
+{
+    return use_hugepages ? (char *)((uintptr_t)p & ~(HUGE_PAGE_SIZE - 1)) : page_floor(p);
+}
+
+/* Heap (and so arena) owning any block or address inside a heap */
+static heap_t *heap_for_ptr(void *p)
+{
+    return (heap_t *)((uintptr_t)p & ~(HEAP_SIZE - 1));
+}
+
+/* Reserve 'len' bytes of PROT_NONE address space aligned to HEAP_SIZE, or NULL */
+static char *reserve_aligned(size_t len)
+{
+    /* Over-reserve by one heap so an aligned start can be cut out of it */
+    size_t span = len + HEAP_SIZE;
+    char *raw = mmap(NULL, span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+
+    char *base = (char *)(((uintptr_t)raw + HEAP_SIZE - 1) & ~(HEAP_SIZE - 1));
+    if (base > raw)
+        munmap(raw, base - raw);
+    if (base + len < raw + span)
+        munmap(base + len, (raw + span) - (base + len));
+    return base;
+}
+
+#ifdef COMPACT_TAGS
+/*
+ * The heap zone: free-list links are 32-bit offsets from zone_base, so
+ * every heap is a HEAP_SIZE slot of one ZONE_SIZE reservation. Slots are
+ * handed out in address order; released heaps go on a free stack.
+ */
+/* A HEAP_SIZE slot of the zone, reserving the zone on first use, or NULL when it is full */
+static char *heap_reserve(void)
+{
+    char *base = NULL;
+
+    pthread_mutex_lock(&zone_lock);
+    if (zone_base == NULL)
+        zone_base = zone_next = reserve_aligned(ZONE_SIZE);
+    if (zone_free != NULL)
+    {
+        base = (char *)zone_free;
+        zone_free = zone_free->prev;
+    }
+    else if (zone_base != NULL && zone_next < zone_base + ZONE_SIZE)
+    {
+        base = zone_next;
+        zone_next += HEAP_SIZE;
+    }
+    pthread_mutex_unlock(&zone_lock);
+    return base;
+}
+
+/* Drop heap h's pages and give its slot back to the zone; the link keeps one page */
+static void heap_release(heap_t *h)
+{
+    mmap(h, HEAP_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    mprotect(h, page_align(sizeof(heap_t)), PROT_READ | PROT_WRITE);
+    pthread_mutex_lock(&zone_lock);
+    h->prev = zone_free;
+    zone_free = h;
+    pthread_mutex_unlock(&zone_lock);
+}
+#else
+static char *heap_reserve(void)
+{
+    return reserve_aligned(HEAP_SIZE);
+}
+
+static void heap_release(heap_t *h)
+{
+    munmap(h, HEAP_SIZE);
+}
+#endif
+
+/*
+ * heap_new - reserve HEAP_SIZE bytes of address space aligned to HEAP_SIZE
+ * and commit the first 'hdr' bytes (heap_t plus anything the caller puts
+ * after it). Nothing beyond that is backed until heap_more_core asks.
+ * Returns NULL if the kernel refuses the mapping.
+ */
+static heap_t *heap_new(size_t hdr)
+{
+    char *base = heap_reserve();
+    if (base == NULL)
+        return NULL;
+
+    if (mprotect(base, page_align(hdr), PROT_READ | PROT_WRITE) != 0)
+    {
+        heap_release((heap_t *)base);
+        return NULL;
+    }
+
+    heap_t *h = (heap_t *)base;
+    h->ar = NULL;
+    h->prev = NULL;
+    h->hi = base + hdr;
+    h->committed = base + page_align(hdr);
+    h->grow_min = 0;
+    h->grow_max = 0;
+    h->commits = 1;
+    atomic_fetch_add_explicit(&heap_commits, 1, memory_order_relaxed);
+    return h;
+}
+
+/*
+ * heap_more_core - sbrk equivalent for a heap: grow its block area by 'size'
+ * bytes, committing pages as needed, and return the old end, or (void *)-1
+ * when the reservation is exhausted. A commit covers at least the heap's
+ * growth step, so pages are committed ahead of the block area. With
+ * M_HUGEPAGES the commit runs to the next 2 MB boundary (heaps are 2 MB
+ * aligned) and the whole huge pages it covers are advised before they are
+ * first touched.
+ */
+static void *heap_more_core(heap_t *h, size_t size)
+{
+    char *old_hi = h->hi;
+
+    if ((size_t)((char *)h + HEAP_SIZE - old_hi) < size)
+        return (void *)-1;
+
+    if (old_hi + size > h->committed)
+    {
+        /* Geometric step: the committed size again, within the heap's bounds */
+        size_t lo = h->grow_min ? h->grow_min : grow_min;
+        size_t hi = h->grow_max ? h->grow_max : grow_max;
+        size_t step = MIN(MAX((size_t)(h->committed - (char *)h), lo), hi);
+        char *commit_end = core_ceil(MAX(old_hi + size, h->committed + step));
+
+        commit_end = MIN(commit_end, (char *)h + HEAP_SIZE);
+        if (mprotect(h->committed, commit_end - h->committed, PROT_READ | PROT_WRITE) != 0)
+            return (void *)-1;
+        if (use_hugepages)
+            madvise(core_floor(h->committed), commit_end - core_floor(h->committed), MADV_HUGEPAGE);
+        h->committed = commit_end;
+        h->commits++;
+        atomic_fetch_add_explicit(&heap_commits, 1, memory_order_relaxed);
+    }
+    h->hi = old_hi + size;
+    return old_hi;
+}
+
+/*
+ * arena_add_heap - make 'h' the arena's top heap and lay down its
+ * prologue and epilogue (2 DWORDs). Returns 0 on success, -1 on error
+ */
+static int arena_add_heap(arena_t *ar, heap_t *h)
+{
+    char *start;
+
+    if ((start = heap_more_core(h, 2 * DWORD)) == (void *)-1)
+        return -1;
+
+    /* Prologue: padding (unused), header, footer, and epilogue header; the first block's payload is DWORD aligned */
+    PUT(start, 0);
+    PUT(start + DWORD - WORD, PACK(DWORD, 1));
+    PUT(start + 2 * DWORD - 2 * WORD, PACK(DWORD, 1));
+    PUT(start + 2 * DWORD - WORD, PACK(0, PREV_ALLOC | 1));
+
+    h->ar = ar;
+    h->prev = ar->top;
+    if (ar->top != NULL)
+    {
+        /* A heap that follows a full one keeps its growth policy */
+        h->grow_min = ar->top->grow_min;
+        h->grow_max = ar->top->grow_max;
+    }
+    ar->top = h;
+    return 0;
+}
+
 /*
  * extend_heap - extend heap by 'words' words, return pointer to new free block's payload
- * We ensure alignment by making the size an even number of WORDs (so result is multiple of DWORD).
+ * We ensure alignment by rounding the size up to a multiple of DWORD.
+ * When the top heap's reservation runs out the arena moves on to a new heap.
  */
-static void *extend_heap(size_t words)
+static void *extend_heap(arena_t *ar, size_t words)
 {
     char *bp;
     size_t size;
+    heap_t *h;
 
     /* Round up to maintain alignment: new block size must be multiple of DWORD */
-    size = (words % 2) ? (words + 1) * WORD : words * WORD;
+    size = DWORD * ((words * WORD + (DWORD - 1)) / DWORD);
 
-    if ((long)(bp = sbrk(size)) == -1)
-        return NULL;
+    if ((bp = heap_more_core(ar->top, size)) == (void *)-1)
+    {
+        /* Top heap's reservation is used up: continue in a fresh heap */
+        if (size > HEAP_SIZE - HEAP_HDR_SIZE - 2 * DWORD)
+            return NULL;
+        if ((h = heap_new(HEAP_HDR_SIZE)) == NULL)
+            return NULL;
+        if (arena_add_heap(ar, h) == -1)
+        {
+            heap_release(h);
+            return NULL;
+        }
+        if ((bp = heap_more_core(h, size)) == (void *)-1)
+            return NULL;
+    }
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
+    /* Pages past the old end have never been written; PREV_ALLOC comes from the old epilogue */
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, prev_alloc | ZEROED));
+    PUT(FTRP(bp), PACK(size, prev_alloc | ZEROED));
     /* New epilogue: zero-size allocated block marks heap end */
     PUT(HDRP(NXT_BLOCK(bp)), PACK(0, 1));
 
-    return coalesce(bp);
+    return coalesce(ar, bp);
 }
 
 /*
- * mminit - create the initial empty heap with prologue and epilogue
- * Returns 0 on success, -1 on error
+ * arena_init_heap - reset the arena's class lists and give it heap 'h'
+ * seeded with a CHUNKSIZE free block. Returns 0 on success, -1 on error
  */
-int mminit(void)
+static int arena_init_heap(arena_t *ar, heap_t *h)
 {
-    if ((heap_list_p = sbrk(4 * WORD)) == (void *)(-1))
+    for (int i = 0; i < NUM_CLASSES; i++)
+        ar->seg_lists[i] = NULL;
+    for (int i = 0; i < NFASTBINS; i++)
+        ar->fastbins[i] = NULL;
+    for (int i = 0; i < NSPAGE_CLASSES; i++)
+        ar->spages[i] = NULL;
+    ar->have_fast = 0;
+    ar->dirty = 0;
+    atomic_store(&ar->remote, NULL);
+    atomic_store(&ar->nremote, 0);
+    ar->top = NULL;
+
+    if (h == NULL || arena_add_heap(ar, h) == -1)
         return -1;
-    free_list_p = NULL;
-    /* Prologue: padding (unused), header, footer, and epilogue header */
-    PUT(heap_list_p, 0);
-    PUT(heap_list_p + WORD, PACK(DWORD, 1));
-    PUT(heap_list_p + (2 * WORD), PACK(DWORD, 1));
-    PUT(heap_list_p + (3 * WORD), PACK(0, 1));
-    /* Point to prologue footer (start of usable heap) */
-    heap_list_p += (2 * WORD);
-
-    if (extend_heap(CHUNKSIZE / WORD) == NULL)
+    if (extend_heap(ar, CHUNKSIZE / WORD) == NULL)
         return -1;
     return 0;
 }
 
+/* (Re)build the main arena on a fresh heap, unmapping any old ones */
+static int main_heap_init(void)
+{
+    heap_t *h = main_arena.top;
+
+    while (h != NULL)
+    {
+        heap_t *prev = h->prev;
+        heap_release(h);
+        h = prev;
+    }
+    return arena_init_heap(&main_arena, heap_new(HEAP_HDR_SIZE));
+}
+
+/*
+ * mminit - create the initial empty heap with prologue and epilogue
+ * Returns 0 on success, -1 on error
+ */
+int mminit(void)
+{
+    /* Blocks cached by this thread belong to the old heap; drop them */
+    memset(&tcache, 0, sizeof(tcache));
+    thread_arena = &main_arena;
+
+    return main_heap_init();
+}
+
+/*
+ * arena_create - build a new arena inside its own first heap, right after
+ * the heap_t. Returns NULL if the kernel refuses the mapping.
+ */
+static arena_t *arena_create(void)
+{
+    heap_t *h = heap_new(HEAP_HDR_SIZE + ARENA_HDR_SIZE);
+    if (h == NULL)
+        return NULL;
+
+    arena_t *ar = (arena_t *)((char *)h + HEAP_HDR_SIZE);
+    pthread_mutex_init(&ar->lock, NULL);
+    if (arena_init_heap(ar, h) == -1)
+    {
+        heap_release(h);
+        return NULL;
+    }
+    return ar;
+}
+
+/* arena_for_ptr - arena owning block bp, read from its heap's header */
+static arena_t *arena_for_ptr(void *bp)
+{
+    return heap_for_ptr(bp)->ar;
+}
+
+/*
+ * arena_next - pick an arena for a thread that has none or found its own busy
+ * The first caller gets the main arena; later callers get a new arena while
+ * under the limit, then existing arenas round-robin.
+ */
+static arena_t *arena_next(arena_t *avoid)
+{
+    arena_t *ar;
+
+    pthread_mutex_lock(&arena_list_lock);
+    if (arena_max == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        arena_max = (cpus > 0) ? (int)cpus * ARENAS_PER_CPU : ARENAS_PER_CPU;
+        if (arena_max > ARENA_MAX)
+            arena_max = ARENA_MAX;
+    }
+
+    unsigned rr = arena_rr++;
+    if (rr > 0 && narenas < arena_max && (ar = arena_create()) != NULL)
+    {
+        arenas[narenas++] = ar;
+    }
+    else
+    {
+        int limit = (narenas < arena_max) ? narenas : arena_max;
+        ar = arenas[rr % limit];
+        if (ar == avoid && limit > 1)
+            ar = arenas[(rr + 1) % limit];
+    }
+    pthread_mutex_unlock(&arena_list_lock);
+    return ar;
+}
+
+/*
+ * arena_get - lock and return the calling thread's arena
+ * If the lock is held by another thread, the thread is moved to the next
+ * arena instead of waiting on this one.
+ */
+static arena_t *arena_get(void)
+{
+    arena_t *ar = thread_arena;
+
+    if (ar == NULL)
+        ar = thread_arena = arena_next(NULL);
+
+    if (pthread_mutex_trylock(&ar->lock) != 0)
+    {
+        ar = thread_arena = arena_next(ar);
+        pthread_mutex_lock(&ar->lock);
+    }
+    return ar;
+}
+
 /*
- * find_fit - first-fit search for a free block with at least 'size' bytes (including header/footer)
+ * find_fit - segregated first-fit search for a free block with at least 'size' bytes
+ * (including header/footer). Starts at the request's own class; any block in a
+ * higher class is already large enough, so those lists stop at their head.
  * Returns payload pointer (bp) or NULL if no fit found.
  */
-static void *find_fit(size_t size)
+static void *find_fit(arena_t *ar, size_t size)
 {
     char *bp;
-    /* Traverse explicit free list from head; O(number of free blocks) vs O(heap size) */
-    for (bp = free_list_p; bp != NULL; bp = GET_NXT_PTR(bp))
+
+    for (int cls = get_class(size); cls < NUM_CLASSES; cls++)
     {
-        if (size <= GET_SIZE(HDRP(bp)))
+        for (bp = ar->seg_lists[cls]; bp != NULL; bp = GET_NXT_PTR(bp))
         {
-            return bp;
+            if (size <= GET_SIZE(HDRP(bp)))
+            {
+                return bp;
+            }
         }
     }
     return NULL;
@@ -192,161 +867,1606 @@ static void *find_fit(size_t size)
 
 /*
  * place - place a block of 'size' bytes at start of free block bp
- * If the remainder would be at least the minimum block size (2*DWORD), split the block.
+ * If the remainder would be at least the minimum block size (MIN_BLOCK), split the block.
+ * Returns ZEROED if the placed payload is zero apart from its first two words.
  */
-static void place(void *bp, size_t size)
+static size_t place(arena_t *ar, void *bp, size_t size)
 {
     size_t asize = GET_SIZE(HDRP(bp));
+    size_t zeroed = GET_ZEROED(HDRP(bp));
 
-    if ((asize - size) >= (2 * DWORD))
+    if ((asize - size) >= MIN_BLOCK)
     {
         /* Fragment is large enough to be a separate block: split */
-        delete_node(bp);
-        PUT(HDRP(bp), PACK((size), 1));
-        PUT(FTRP(bp), PACK((size), 1));
+        delete_node(ar, bp);
+        PUT(HDRP(bp), PACK((size), PREV_ALLOC | 1));
 
-        PUT(HDRP(NXT_BLOCK(bp)), PACK((asize - size), 0));
-        PUT(FTRP(NXT_BLOCK(bp)), PACK((asize - size), 0));
-        insert_node(NXT_BLOCK(bp));
+        /* Remainder's new header lands in zeroed payload, so it keeps the flag */
+        PUT(HDRP(NXT_BLOCK(bp)), PACK((asize - size), PREV_ALLOC | zeroed));
+        PUT(FTRP(NXT_BLOCK(bp)), PACK((asize - size), PREV_ALLOC | zeroed));
+        insert_node(ar, NXT_BLOCK(bp));
     }
     else
     {
         /* Fragment too small; allocate entire block to avoid excessive fragmentation */
-        delete_node(bp);
-        PUT(HDRP(bp), PACK((asize), 1));
-        PUT(FTRP(bp), PACK((asize), 1));
+        delete_node(ar, bp);
+        if (zeroed)
+            PUT(FTRP(bp), 0); /* the old footer is payload now */
+        PUT(HDRP(bp), PACK((asize), PREV_ALLOC | 1));
+        SET_PREV_ALLOC(NXT_BLOCK(bp));
     }
+    return zeroed;
+}
+
+/* Block size (payload + header, DWORD aligned) for a request of 'size' bytes */
+static size_t adjust_size(size_t size)
+{
+    /* Minimum allocation: MIN_BLOCK (header + 2 links for free list + footer, once freed) */
+    if (size + WORD <= MIN_BLOCK)
+        return MIN_BLOCK;
+    /* Round up to nearest multiple of DWORD for alignment; allocated blocks have no footer */
+    return DWORD * ((size + WORD + (DWORD - 1)) / DWORD);
 }
 
 /*
- * my_malloc - allocate a block with at least 'size' bytes of payload
- * Returns pointer to payload, or NULL on failure
+ * heap_trim - shrink the heap under top free block bp down to TRIM_KEEP bytes
+ * (rounded so the new end is page aligned, or huge page aligned). The cut pages are replaced by a
+ * fresh PROT_NONE mapping, which drops them and keeps the reservation, so
+ * heap_more_core can commit them again later.
  */
-void *my_malloc(size_t size)
+static void heap_trim(arena_t *ar, char *bp)
 {
-    char *bp;
-    size_t asize;
+    heap_t *h = heap_for_ptr(bp);
+    char *new_hi = core_ceil(bp + TRIM_KEEP);
 
-    if (heap_list_p == 0)
-    {
-        mminit();
-    }
+    if (new_hi >= h->hi)
+        return;
+    if (mmap(new_hi, h->committed - new_hi, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+        return;
 
-    if (size <= 0)
-        return NULL;
+    size_t zeroed = GET_ZEROED(HDRP(bp));
+    delete_node(ar, bp);
+    PUT(HDRP(bp), PACK(new_hi - (char *)bp, PREV_ALLOC | zeroed));
+    PUT(FTRP(bp), PACK(new_hi - (char *)bp, PREV_ALLOC | zeroed));
+    PUT(HDRP(NXT_BLOCK(bp)), PACK(0, 1));
+    insert_node(ar, bp);
+    h->hi = new_hi;
+    h->committed = new_hi;
+}
 
-    /* Minimum allocation: 2*DWORD (header + 2 pointers for free list + footer) */
-    if (size <= DWORD)
-        asize = (2 * DWORD);
-    else
-    {
-        /* Round up to nearest multiple of DWORD for alignment */
-        asize = DWORD * ((size + DWORD + (DWORD - 1)) / DWORD);
-    }
+/*
+ * release_block_pages - drop the physical pages wholly inside free block bp
+ * The header, the free-list links at the start of the payload and the
+ * footer stay resident, so the block remains a valid list node; the
+ * released pages read back as zeros (or stale data with MADV_FREE).
+ * With M_HUGEPAGES only whole huge pages go, so none is split.
+ */
+static void release_block_pages(char *bp)
+{
+    char *lo = core_ceil(bp + 2 * WORD);
+    char *hi = core_floor(FTRP(bp));
+
+    if (hi > lo)
+        madvise(lo, hi - lo, RELEASE_ADVICE);
+}
 
-    if ((bp = find_fit(asize)) != NULL)
+/*
+ * arena_release_pages - madvise pass over the arena's free blocks
+ * Runs once per release_threshold bytes freed rather than on every free;
+ * only classes that can hold multi-page blocks are visited.
+ */
+static void arena_release_pages(arena_t *ar)
+{
+    for (int cls = get_class(2 * page_align(1)); cls < NUM_CLASSES; cls++)
     {
-        place(bp, asize);
-        return bp;
+        for (char *bp = ar->seg_lists[cls]; bp != NULL; bp = GET_NXT_PTR(bp))
+            release_block_pages(bp);
     }
+    ar->dirty = 0;
+}
 
-    /* No fit found; extend heap by max(requested, CHUNKSIZE) */
-    size_t extension = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extension / WORD)) != NULL)
+static void free_block(arena_t *ar, void *bp);
+
+/*
+ * consolidate - empty every fast bin of 'ar' through free_block, so the
+ * deferred blocks finally coalesce with their neighbours.
+ * Caller must hold ar->lock.
+ */
+static void consolidate(arena_t *ar)
+{
+    for (int i = 0; i < NFASTBINS; i++)
     {
-        place(bp, asize);
-        return bp;
+        char *bp = ar->fastbins[i];
+        ar->fastbins[i] = NULL;
+
+        while (bp != NULL)
+        {
+            char *next = FB_NEXT(bp);
+            free_block(ar, bp);
+            bp = next;
+        }
     }
-    return NULL;
+    ar->have_fast = 0;
 }
 
+static void free_to_arena(arena_t *ar, void *bp);
+
 /*
- * my_free - free a previously allocated block and coalesce if possible
+ * Remote frees
+ *
+ * Each arena has a Treiber stack of blocks that threads not bound to it
+ * have freed. Pushing is one CAS on the head; draining swaps the whole
+ * stack out with one exchange, so there is no ABA problem and a pusher
+ * never waits for the arena lock. The owner drains in malloc_block; a
+ * pusher that sees REMOTE_DRAIN_BATCH blocks waiting drains too, but only
+ * if trylock succeeds, so an idle owner cannot let the stack grow without
+ * bound. Queued blocks stay tagged allocated, like tcache entries.
  */
-void my_free(void *bp)
+static void remote_push(arena_t *ar, char *bp)
 {
-    size_t size = GET_SIZE(HDRP(bp));
+    char *head = atomic_load_explicit(&ar->remote, memory_order_relaxed);
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    do
+        RF_NEXT(bp) = head;
+    while (!atomic_compare_exchange_weak_explicit(&ar->remote, &head, bp,
+                                                  memory_order_release, memory_order_relaxed));
 }
 
-void *my_realloc(void *ptr, size_t size)
+/* Free every block on ar's remote stack. Caller must hold ar->lock */
+static void remote_drain(arena_t *ar)
 {
-    if (size == 0)
+    char *bp = atomic_exchange_explicit(&ar->remote, NULL, memory_order_acquire);
+    size_t n = 0;
+
+    while (bp != NULL)
     {
-        my_free(ptr);
-        return NULL;
+        char *next = RF_NEXT(bp);
+        free_to_arena(ar, bp);
+        bp = next;
+        n++;
     }
+    atomic_fetch_sub_explicit(&ar->nremote, n, memory_order_relaxed);
+}
 
-    if (ptr == NULL)
+/* Free bp into arena ar from a thread not bound to it */
+static void remote_free(arena_t *ar, char *bp)
+{
+    remote_push(ar, bp);
+    if (atomic_fetch_add_explicit(&ar->nremote, 1, memory_order_relaxed) + 1 >= REMOTE_DRAIN_BATCH &&
+        pthread_mutex_trylock(&ar->lock) == 0)
     {
-        return my_malloc(size);
+        remote_drain(ar);
+        pthread_mutex_unlock(&ar->lock);
     }
+}
 
-    size_t asize;
-    if (size <= DWORD)
-        asize = 2 * DWORD;
-    else
-        asize = DWORD * ((size + DWORD + (DWORD - 1)) / DWORD);
-
-    size_t old_size = GET_SIZE(HDRP(ptr));
+/*
+ * malloc_block - find or make room for an 'asize'-byte block in arena 'ar'
+ * If 'zeroed' is not NULL it receives place's known-zero result.
+ * Blocks other threads freed into the arena are taken in first. An exact
+ * fast-bin hit is returned as is. Large requests, and any request about
+ * to grow the heap, first consolidate the fast bins.
+ * Caller must hold ar->lock.
+ */
+static void *malloc_block(arena_t *ar, size_t asize, size_t *zeroed)
+{
+    char *bp;
+    size_t z;
 
-    if (asize <= old_size)
+    if (ar->top == NULL)
     {
-        /* Shrink or no change: split if fragment is large enough */
-        if ((old_size - asize) >= (2 * DWORD))
-        {
-            PUT(HDRP(ptr), PACK(asize, 1));
-            PUT(FTRP(ptr), PACK(asize, 1));
+        /* Only the main arena starts out empty (lazy initialization) */
+        if (main_heap_init() == -1)
+            return NULL;
+    }
 
-            void *next_ptr = NXT_BLOCK(ptr);
-            PUT(HDRP(next_ptr), PACK(old_size - asize, 0));
-            PUT(FTRP(next_ptr), PACK(old_size - asize, 0));
+    if (atomic_load_explicit(&ar->remote, memory_order_relaxed) != NULL)
+        remote_drain(ar);
 
-            coalesce(next_ptr);
+    if (ar->have_fast)
+    {
+        if (asize <= fastbin_max && (bp = ar->fastbins[FASTBIN_INDEX(asize)]) != NULL)
+        {
+            ar->fastbins[FASTBIN_INDEX(asize)] = FB_NEXT(bp);
+            if (zeroed != NULL)
+                *zeroed = 0;
+            return bp;
         }
-        return ptr;
+        if (asize > SMALL_CLASS_MAX)
+            consolidate(ar);
     }
 
-    /* Need to grow: try to use free adjacent block without moving data */
-    size_t next_alloc = GET_ALLOC(HDRP(NXT_BLOCK(ptr)));
-    size_t next_size = GET_SIZE(HDRP(NXT_BLOCK(ptr)));
-    size_t total_avail = old_size + next_size;
+    if ((bp = find_fit(ar, asize)) == NULL && ar->have_fast)
+    {
+        /* Merged fast-bin blocks may fit before the heap has to grow */
+        consolidate(ar);
+        bp = find_fit(ar, asize);
+    }
+
+    if (bp == NULL)
+    {
+        /* No fit found; extend heap by max(requested, CHUNKSIZE) */
+        size_t extension = MAX(asize, CHUNKSIZE);
+        if ((bp = extend_heap(ar, extension / WORD)) == NULL)
+            return NULL;
+    }
+
+    z = place(ar, bp, asize);
+    if (zeroed != NULL)
+        *zeroed = z;
+    return bp;
+}
+
+/*
+ * free_block - return an allocated block to arena 'ar' and coalesce
+ * Caller must hold ar->lock.
+ */
+static void free_block(arena_t *ar, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, prev_alloc));
+    PUT(FTRP(bp), PACK(size, prev_alloc));
+    bp = coalesce(ar, bp);
+
+    /* Top block: give the tail back to the OS */
+    if (GET_SIZE(HDRP(NXT_BLOCK(bp))) == 0 && GET_SIZE(HDRP(bp)) >= trim_threshold)
+        heap_trim(ar, bp);
+
+    ar->dirty += size;
+    if (ar->dirty >= release_threshold)
+        arena_release_pages(ar);
+}
+
+static void page_free_local(arena_t *ar, char *bp);
+
+/*
+ * free_to_arena - free path for single blocks: page objects go back to
+ * their page; with fast bins on, small blocks are pushed still tagged
+ * allocated and left unmerged; freeing a large block flushes the bins as
+ * glibc does.
+ * Caller must hold ar->lock.
+ */
+static void free_to_arena(arena_t *ar, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (IS_PAGED(GET(HDRP(bp))))
+    {
+        page_free_local(ar, bp);
+        return;
+    }
+    if (size <= fastbin_max)
+    {
+        FB_NEXT(bp) = ar->fastbins[FASTBIN_INDEX(size)];
+        ar->fastbins[FASTBIN_INDEX(size)] = bp;
+        ar->have_fast = 1;
+        return;
+    }
+    free_block(ar, bp);
+    if (ar->have_fast && size >= FASTBIN_CONSOLIDATION_THRESHOLD)
+        consolidate(ar);
+}
+
+/*
+ * memalign_block - allocate an 'asize'-byte block whose payload is aligned
+ * to 'align' (a power of two above DWORD) in arena 'ar'
+ * Over-allocates by the worst-case lead, then frees the leading and
+ * trailing slop as ordinary blocks so they coalesce back into the lists.
+ * Caller must hold ar->lock.
+ */
+static void *memalign_block(arena_t *ar, size_t align, size_t asize)
+{
+    char *bp = malloc_block(ar, asize + align + MIN_BLOCK, NULL);
+    if (bp == NULL)
+        return NULL;
+
+    size_t size = GET_SIZE(HDRP(bp));
+    char *abp = (char *)(((uintptr_t)bp + align - 1) & ~(align - 1));
+
+    if (abp != bp)
+    {
+        /* The lead must be able to stand alone as a free block */
+        if ((size_t)(abp - bp) < MIN_BLOCK)
+            abp += align;
+        size_t lead = abp - bp;
+
+        PUT(HDRP(abp), PACK(size - lead, 1));
+        PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp)) | 1));
+        free_block(ar, bp);
+
+        bp = abp;
+        size -= lead;
+    }
+
+    if ((size - asize) >= MIN_BLOCK)
+    {
+        PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+
+        char *rest = NXT_BLOCK(bp);
+        PUT(HDRP(rest), PACK(size - asize, PREV_ALLOC | 1));
+        free_block(ar, rest);
+    }
+    return bp;
+}
+
+/*
+ * Small-object pages (mimalloc style)
+ *
+ * With my_mallopt(M_SMALL_PAGES, n) on, requests up to n bytes come from
+ * SPAGE_SIZE pages. A page is one size-aligned heap block that serves a
+ * single block size. Objects are cut back to back with a bump pointer,
+ * so consecutive mallocs are contiguous. Freed objects go on the page's
+ * own LIFO list, so a hit is one pointer pop. Objects keep an allocated
+ * header tagged PAGED and no footer (they never coalesce), and the page
+ * is found by masking the address.
+ *
+ * The arena lock guards each local list. Threads not using the arena
+ * push their frees onto the page's atomic thread_free list instead, and
+ * the page collects them when its local list runs dry. A page with no
+ * room is unlinked, and its thread_free is set to PAGE_FULL, so later
+ * remote frees take the arena's remote stack, whose drain relinks the
+ * page. A page whose objects are all free goes back to the heap, unless
+ * it is the last page of its size.
+ */
+static spage_t *page_for_ptr(void *bp)
+{
+    return (spage_t *)((uintptr_t)bp & ~(uintptr_t)(SPAGE_SIZE - 1));
+}
+
+static void page_link(arena_t *ar, spage_t *pg)
+{
+    spage_t **head = &ar->spages[SPAGE_CLASS(pg->asize)];
+
+    pg->prev = NULL;
+    pg->next = *head;
+    if (*head != NULL)
+        (*head)->prev = pg;
+    *head = pg;
+}
+
+static void page_unlink(arena_t *ar, spage_t *pg)
+{
+    if (pg->prev != NULL)
+        pg->prev->next = pg->next;
+    else
+        ar->spages[SPAGE_CLASS(pg->asize)] = pg->next;
+    if (pg->next != NULL)
+        pg->next->prev = pg->prev;
+}
+
+/* Cut a fresh page for 'asize'-byte objects out of the heap. Caller must hold ar->lock */
+static spage_t *page_new(arena_t *ar, size_t asize)
+{
+    spage_t *pg = memalign_block(ar, SPAGE_SIZE, adjust_size(SPAGE_SIZE));
+
+    if (pg == NULL)
+        return NULL;
+    pg->free = NULL;
+    atomic_store_explicit(&pg->thread_free, NULL, memory_order_relaxed);
+    pg->bump = (char *)pg + SPAGE_HDR_SIZE;
+    pg->end = (char *)pg + SPAGE_SIZE;
+    pg->asize = asize;
+    pg->used = 0;
+    pg->full = 0;
+    page_link(ar, pg);
+    return pg;
+}
+
+/* Move the objects other threads freed onto the local list. Caller must hold ar->lock */
+static void page_collect(spage_t *pg)
+{
+    char *bp = atomic_exchange_explicit(&pg->thread_free, NULL, memory_order_acquire);
+
+    while (bp != NULL)
+    {
+        char *next = RF_NEXT(bp);
+        RF_NEXT(bp) = pg->free;
+        pg->free = bp;
+        pg->used--;
+        bp = next;
+    }
+}
+
+/*
+ * page_malloc - an 'asize'-byte object from the arena's pages, or NULL
+ * if no page can be made. Local free list first, then objects other
+ * threads freed, then the bump pointer; a page with none of them is
+ * parked and the next one tried. Caller must hold ar->lock.
+ */
+static void *page_malloc(arena_t *ar, size_t asize)
+{
+    char *bp;
+
+    /* Remote frees to parked pages bring those pages back */
+    if (atomic_load_explicit(&ar->remote, memory_order_relaxed) != NULL)
+        remote_drain(ar);
+
+    spage_t *pg = ar->spages[SPAGE_CLASS(asize)];
+    for (;;)
+    {
+        if (pg == NULL && (pg = page_new(ar, asize)) == NULL)
+            return NULL;
+
+        if (pg->free == NULL && atomic_load_explicit(&pg->thread_free, memory_order_relaxed) != NULL)
+            page_collect(pg);
+        if ((bp = pg->free) != NULL)
+        {
+            pg->free = RF_NEXT(bp);
+            pg->used++;
+            return bp;
+        }
+        if (pg->bump + asize - WORD <= pg->end)
+        {
+            bp = pg->bump;
+            pg->bump += asize;
+            PUT(HDRP(bp), PACK(asize, PAGED | 1));
+            pg->used++;
+            return bp;
+        }
+
+        /* No room: park the page, unless a remote free slipped in first */
+        char *empty = NULL;
+        if (atomic_compare_exchange_strong(&pg->thread_free, &empty, PAGE_FULL))
+        {
+            spage_t *next = pg->next;
+            page_unlink(ar, pg);
+            pg->full = 1;
+            pg = next;
+        }
+    }
+}
+
+/* Return page object bp to its page's local list. Caller must hold ar->lock */
+static void page_free_local(arena_t *ar, char *bp)
+{
+    spage_t *pg = page_for_ptr(bp);
+
+    RF_NEXT(bp) = pg->free;
+    pg->free = bp;
+    pg->used--;
+
+    if (pg->full)
+    {
+        /* Room again: relink, and let remote frees use thread_free again */
+        pg->full = 0;
+        atomic_store_explicit(&pg->thread_free, NULL, memory_order_release);
+        page_link(ar, pg);
+    }
+
+    /* Everything back (objects on thread_free still count as used): release the page */
+    if (pg->used == 0 && (ar->spages[SPAGE_CLASS(pg->asize)] != pg || pg->next != NULL))
+    {
+        page_unlink(ar, pg);
+        free_to_arena(ar, pg);
+    }
+}
+
+/* Free page object bp from a thread not using arena 'ar': never takes a lock */
+static void page_free_remote(arena_t *ar, char *bp)
+{
+    spage_t *pg = page_for_ptr(bp);
+    char *head = atomic_load_explicit(&pg->thread_free, memory_order_relaxed);
+
+    do
+    {
+        if (head == PAGE_FULL)
+        {
+            /* Parked page: the arena's drain frees it locally and relinks the page */
+            remote_free(ar, bp);
+            return;
+        }
+        RF_NEXT(bp) = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pg->thread_free, &head, bp,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/*
+ * carve_run - split up to 'n' blocks of 'asize' bytes off the front of free
+ * block bp in one pass, storing them in out[]. A remainder too small to
+ * stand alone goes to the last block. Returns the number of blocks carved.
+ * Caller must hold ar->lock.
+ */
+static size_t carve_run(arena_t *ar, char *bp, size_t asize, size_t n, void **out)
+{
+    size_t total = GET_SIZE(HDRP(bp));
+    size_t zeroed = GET_ZEROED(HDRP(bp));
+    size_t k = MIN(n, total / asize);
+    size_t rest = total - k * asize;
+
+    delete_node(ar, bp);
+    for (size_t i = 0; i < k; i++)
+    {
+        size_t bsize = (i == k - 1 && rest < MIN_BLOCK) ? asize + rest : asize;
+        PUT(HDRP(bp), PACK(bsize, PREV_ALLOC | 1));
+        out[i] = bp;
+        bp += bsize;
+    }
+
+    if (rest >= MIN_BLOCK)
+    {
+        /* As in place(): the remainder's payload was never written */
+        PUT(HDRP(bp), PACK(rest, PREV_ALLOC | zeroed));
+        PUT(FTRP(bp), PACK(rest, PREV_ALLOC | zeroed));
+        insert_node(ar, bp);
+    }
+    else
+    {
+        SET_PREV_ALLOC(bp);
+    }
+    return k;
+}
+
+/*
+ * Direct-mapped large blocks
+ *
+ * Layout of a mapping (the header size is the whole mapping length):
+ *    [ ...slop | offset word | header (size | MMAPPED | 1) | payload ... ]
+ * The offset word lets an aligned payload sit anywhere in the mapping.
+ * Freeing unmaps the region, so a large transient buffer never pins
+ * arena memory or fragments the heap. No lock is needed on either path.
+ */
+static void *mmap_chunk(size_t size, size_t align)
+{
+    if (size > SIZE_MAX - DWORD - align - page_align(1))
+    {
+        errno = ENOMEM; /* the mapping length would wrap */
+        return NULL;
+    }
+
+    size_t len = page_align(size + DWORD + (align > DWORD ? align : 0));
+
+    if ((tag_t)len != len)
+    {
+        errno = ENOMEM; /* compact tags: the length does not fit the header */
+        return NULL;
+    }
+    char *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (use_hugepages && len >= HUGE_PAGE_SIZE)
+        madvise(base, len, MADV_HUGEPAGE);
+
+    char *bp = base + DWORD;
+    if (align > DWORD)
+        bp = (char *)(((uintptr_t)bp + align - 1) & ~(align - 1));
+    MMAP_OFFSET(bp) = bp - base;
+    PUT(HDRP(bp), PACK(len, MMAPPED | 1));
+    return bp;
+}
+
+static void munmap_chunk(void *bp)
+{
+    munmap((char *)bp - MMAP_OFFSET(bp), GET_SIZE(HDRP(bp)));
+}
+
+/* Payload bytes available in a mapped block */
+static size_t mmap_usable_size(void *bp)
+{
+    return GET_SIZE(HDRP(bp)) - MMAP_OFFSET(bp);
+}
+
+/*
+ * Thread cache (tcache)
+ *
+ * Each thread keeps a small LIFO stack of recently freed blocks per block
+ * size, in front of the shared heap. A cached block stays marked allocated,
+ * so neighbours never coalesce into it. Hits touch only thread-local state
+ * and never take an arena lock.
+ *
+ * - Bin i holds blocks of exactly MIN_BLOCK + i * DWORD bytes: 32 .. 1040
+ *   (16 .. 1024 with compact tags).
+ * - A bin holds at most tcache_count blocks. Freeing into a full bin first
+ *   flushes its older half back to the heap under a single lock acquisition.
+ * - A pthread key destructor flushes everything when the thread exits.
+ */
+static void tcache_flush_bin(tcache_t *tc, int bin, int keep)
+{
+    char **link = &tc->entries[bin];
+    arena_t *locked = NULL;
+    char *bp;
+
+    /* Keep the 'keep' most recently freed (cache-hot) blocks, flush the rest */
+    for (int i = 0; i < keep && *link != NULL; i++)
+        link = &TC_NEXT(*link);
+    bp = *link;
+    *link = NULL;
+
+    /* Route each block to its owning arena, re-locking only when the owner changes */
+    while (bp != NULL)
+    {
+        char *next = TC_NEXT(bp);
+        arena_t *ar = arena_for_ptr(bp);
+
+        if (ar != locked)
+        {
+            if (locked)
+                pthread_mutex_unlock(&locked->lock);
+            pthread_mutex_lock(&ar->lock);
+            locked = ar;
+        }
+        free_to_arena(ar, bp);
+        tc->counts[bin]--;
+        bp = next;
+    }
+    if (locked)
+        pthread_mutex_unlock(&locked->lock);
+}
+
+/* Thread exit: hand every cached block back to the shared heap */
+static void tcache_destroy(void *arg)
+{
+    tcache_t *tc = arg;
+
+    for (int bin = 0; bin < TCACHE_MAX_BINS; bin++)
+    {
+        if (tc->counts[bin] > 0)
+            tcache_flush_bin(tc, bin, 0);
+    }
+}
+
+static void tcache_key_create(void)
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/* Pop a cached block of exactly 'asize' bytes, or NULL on a miss */
+static void *tcache_get(size_t asize)
+{
+    int bin = TCACHE_BIN(asize);
+    char *bp;
+
+    if (bin >= TCACHE_MAX_BINS || (bp = tcache.entries[bin]) == NULL)
+        return NULL;
+
+    tcache.entries[bin] = TC_NEXT(bp);
+    tcache.counts[bin]--;
+    return bp;
+}
+
+/* Cache an allocated block of 'size' bytes. Returns 0 if the block is not cacheable */
+static int tcache_put(void *bp, size_t size)
+{
+    int bin = TCACHE_BIN(size);
+
+    if (bin >= TCACHE_MAX_BINS || tcache_count == 0)
+        return 0;
+
+    if (!tcache_registered)
+    {
+        /* First cached block in this thread: arrange the exit-time flush */
+        pthread_once(&tcache_key_once, tcache_key_create);
+        pthread_setspecific(tcache_key, &tcache);
+        tcache_registered = 1;
+    }
+
+    if (tcache.counts[bin] >= tcache_count)
+        tcache_flush_bin(&tcache, bin, tcache_count / 2);
+
+    TC_NEXT(bp) = tcache.entries[bin];
+    tcache.entries[bin] = bp;
+    tcache.counts[bin]++;
+    return 1;
+}
+
+/*
+ * Sampling heap profiler
+ *
+ * Each thread counts down a random number of bytes, drawn from an
+ * exponential distribution with mean prof_interval, and samples the
+ * allocation that crosses zero: a backtrace is stored in a hash table
+ * keyed by address and the block header is tagged SAMPLED, so the free
+ * path only touches the profiler for sampled blocks. Freed samples stay
+ * in the table (for the alloc-space view) until it fills up, then are
+ * compacted away. Everything lives in mmap'd memory and no allocator lock
+ * is held while sampling, so backtrace() may itself call malloc. The tag
+ * itself is set and cleared under the block's arena lock, like every
+ * other boundary tag update.
+ */
+typedef struct prof_sample_t
+{
+    void *ptr;                      /* NULL marks an empty slot */
+    size_t size;                    /* requested bytes */
+    int live;                       /* 0 once freed */
+    int depth;
+    void *frames[PROF_MAX_DEPTH];
+} prof_sample_t;
+
+static size_t prof_interval = 0;    /* mean bytes between samples; 0 = off */
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static prof_sample_t *prof_table, *prof_spare;
+static size_t prof_used;            /* occupied slots in prof_table */
+static size_t prof_dropped;         /* samples lost to a full table */
+static __thread long prof_countdown;
+static __thread uint64_t prof_rng;
+static __thread int prof_busy;      /* inside prof_sample: do not sample recursively */
+
+static size_t prof_slot(void *ptr)
+{
+    return (((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL >> 32) & (PROF_TABLE_SIZE - 1);
+}
+
+/* Bytes until the next sample: -ln(u) * prof_interval, with u uniform in (0, 1] */
+static long prof_next_countdown(void)
+{
+    if (prof_rng == 0)
+        prof_rng = (uintptr_t)&prof_rng ^ 0x2545F4914F6CDD1DULL;
+    prof_rng ^= prof_rng << 13;
+    prof_rng ^= prof_rng >> 7;
+    prof_rng ^= prof_rng << 17;
+
+    /* log2(u) for u = q / 2^26: the double's exponent plus a quadratic fit of log2 over its mantissa */
+    union { double d; uint64_t i; } q = {.d = (double)((prof_rng >> 38) + 1)};
+    union { uint64_t i; double d; } m = {.i = (q.i & ((1ULL << 52) - 1)) | (1023ULL << 52)};
+    double log2_u = (double)((int)(q.i >> 52) - 1023) + (-0.34484843 * m.d + 2.02466578) * m.d - 1.67487759 - 26;
+
+    return (long)(-log2_u * 0.6931471805599453 * (double)prof_interval) + 1;
+}
+
+/* Insert into 'table' by linear probing. Caller holds prof_lock */
+static prof_sample_t *prof_insert(prof_sample_t *table, void *ptr)
+{
+    size_t i = prof_slot(ptr);
+
+    while (table[i].ptr != NULL)
+        i = (i + 1) & (PROF_TABLE_SIZE - 1);
+    table[i].ptr = ptr;
+    return &table[i];
+}
+
+/* Drop freed samples by rehashing live ones into the spare table. Caller holds prof_lock */
+static void prof_compact(void)
+{
+    prof_sample_t *old = prof_table;
+
+    memset(prof_spare, 0, PROF_TABLE_SIZE * sizeof(prof_sample_t));
+    prof_used = 0;
+    for (size_t i = 0; i < PROF_TABLE_SIZE; i++)
+    {
+        if (old[i].ptr != NULL && old[i].live)
+        {
+            *prof_insert(prof_spare, old[i].ptr) = old[i];
+            prof_used++;
+        }
+    }
+    prof_table = prof_spare;
+    prof_spare = old;
+}
+
+/*
+ * prof_retag - set or clear bp's SAMPLED tag. A heap block's header word
+ * also holds PREV_ALLOC, which its neighbours rewrite under the arena
+ * lock, so the read-modify-write takes that lock unless the caller
+ * already holds it ('locked'); even a remote free of a sampled block
+ * waits for the owner's lock. Mapped blocks and page objects have no
+ * neighbours and need none.
+ */
+static void prof_retag(void *bp, int sampled, arena_t *locked)
+{
+    uintptr_t hdr = GET_SHARED(HDRP(bp));
+    arena_t *ar = (IS_MMAPPED(hdr) || IS_PAGED(hdr)) ? NULL : arena_for_ptr(bp);
+
+    if (ar == locked)
+        ar = NULL;
+    if (ar != NULL)
+        pthread_mutex_lock(&ar->lock);
+    if (sampled)
+        PUT_SHARED(HDRP(bp), GET(HDRP(bp)) | SAMPLED);
+    else
+        PUT_SHARED(HDRP(bp), GET(HDRP(bp)) & ~(uintptr_t)SAMPLED);
+    if (ar != NULL)
+        pthread_mutex_unlock(&ar->lock);
+}
+
+/* Record allocation bp: called when the countdown crosses zero */
+ALLOC_TEXT __attribute__((noinline)) static void prof_sample(void *bp, size_t size)
+{
+    void *frames[PROF_MAX_DEPTH + PROF_SKIP_FRAMES];
+    int first_draw = (prof_rng == 0);
+
+    prof_countdown = prof_next_countdown();
+    if (first_draw || prof_busy)
+        return;
+
+    prof_busy = 1;
+    int n = backtrace(frames, PROF_MAX_DEPTH + PROF_SKIP_FRAMES);
+    int skip = 0;
+    while (skip < n && !IN_ALLOC_TEXT(frames[skip])) /* backtrace's own frames, e.g. a sanitizer interceptor */
+        skip++;
+    while (skip < n && IN_ALLOC_TEXT(frames[skip]))
+        skip++;
+    int depth = MIN(n - skip, PROF_MAX_DEPTH);
+    int stored = 0;
+
+    pthread_mutex_lock(&prof_lock);
+    if (prof_used >= PROF_TABLE_SIZE * 3 / 4)
+        prof_compact();
+    if (prof_used >= PROF_TABLE_SIZE * 3 / 4)
+    {
+        prof_dropped++;
+    }
+    else
+    {
+        prof_sample_t *smp = prof_insert(prof_table, bp);
+        smp->size = size;
+        smp->live = 1;
+        smp->depth = (depth > 0) ? depth : 0;
+        memcpy(smp->frames, frames + skip, smp->depth * sizeof(void *));
+        prof_used++;
+        stored = 1;
+    }
+    pthread_mutex_unlock(&prof_lock);
+    if (stored)
+        prof_retag(bp, 1, NULL);
+    prof_busy = 0;
+}
+
+/* Allocation exit hook: one thread-local subtraction unless a sample is due */
+__attribute__((always_inline)) static inline void *prof_hook(void *bp, size_t size)
+{
+    if (prof_interval != 0 && bp != NULL && (prof_countdown -= (long)size) < 0)
+        prof_sample(bp, size);
+    return bp;
+}
+
+/* Free hook for a SAMPLED block: mark its sample freed and clear the tag; 'locked' as for prof_retag */
+static void prof_free(void *bp, arena_t *locked)
+{
+    pthread_mutex_lock(&prof_lock);
+    for (size_t i = prof_slot(bp); prof_table[i].ptr != NULL; i = (i + 1) & (PROF_TABLE_SIZE - 1))
+    {
+        if (prof_table[i].ptr == bp && prof_table[i].live)
+        {
+            prof_table[i].live = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+    prof_retag(bp, 0, locked);
+}
+
+/*
+ * prof_move - realloc resized SAMPLED block 'old' into bp (in place or by
+ * moving it) without freeing it: end the old sample and record bp at its
+ * new 'size' under the same stack. The resize rewrote the header, so the
+ * tag is set again. Returns bp.
+ */
+static void *prof_move(void *old, void *bp, size_t size)
+{
+    prof_sample_t moved;
+    int found = 0, stored = 0;
+
+    pthread_mutex_lock(&prof_lock);
+    for (size_t i = prof_slot(old); prof_table[i].ptr != NULL; i = (i + 1) & (PROF_TABLE_SIZE - 1))
+    {
+        if (prof_table[i].ptr == old && prof_table[i].live)
+        {
+            prof_table[i].live = 0;
+            moved = prof_table[i];
+            found = 1;
+            break;
+        }
+    }
+    if (found && prof_used >= PROF_TABLE_SIZE * 3 / 4)
+        prof_compact();
+    if (found && prof_used >= PROF_TABLE_SIZE * 3 / 4)
+    {
+        prof_dropped++;
+    }
+    else if (found)
+    {
+        prof_sample_t *smp = prof_insert(prof_table, bp);
+        smp->size = size;
+        smp->live = 1;
+        smp->depth = moved.depth;
+        memcpy(smp->frames, moved.frames, moved.depth * sizeof(void *));
+        prof_used++;
+        stored = 1;
+    }
+    pthread_mutex_unlock(&prof_lock);
+    prof_retag(bp, stored, NULL);
+    return bp;
+}
+
+/* Map both sample tables on first enable. Returns 0 on success */
+static int prof_init(void)
+{
+    size_t len = PROF_TABLE_SIZE * sizeof(prof_sample_t);
+
+    pthread_mutex_lock(&prof_lock);
+    if (prof_table == NULL)
+    {
+        char *mem = mmap(NULL, 2 * len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem != MAP_FAILED)
+        {
+            prof_table = (prof_sample_t *)mem;
+            prof_spare = (prof_sample_t *)(mem + len);
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+    return (prof_table != NULL) ? 0 : -1;
+}
+
+static void prof_write(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+/*
+ * my_heap_profile_dump - write the samples to 'fd' in the legacy gperftools
+ * heap profile format ("heap_v2"), readable by pprof:
+ *    heap profile: <live>: <live bytes> [<all>: <all bytes>] @ heap_v2/<interval>
+ *    1: <bytes> [1: <bytes>] @ 0x... 0x...      (a live sample)
+ *    0: 0 [1: <bytes>] @ 0x... 0x...            (a freed sample)
+ *    MAPPED_LIBRARIES: <copy of /proc/self/maps>
+ * pprof scales the sampled sizes back up using the interval.
+ * Returns 0 on success, -1 if profiling was never enabled.
+ */
+int my_heap_profile_dump(int fd)
+{
+    char line[64 + PROF_MAX_DEPTH * 20];
+    size_t live = 0, live_bytes = 0, all = 0, all_bytes = 0;
+
+    if (prof_table == NULL)
+        return -1;
+
+    pthread_mutex_lock(&prof_lock);
+    for (size_t i = 0; i < PROF_TABLE_SIZE; i++)
+    {
+        if (prof_table[i].ptr == NULL)
+            continue;
+        all++;
+        all_bytes += prof_table[i].size;
+        if (prof_table[i].live)
+        {
+            live++;
+            live_bytes += prof_table[i].size;
+        }
+    }
+    int n = snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+                     live, live_bytes, all, all_bytes, prof_interval);
+    prof_write(fd, line, n);
+
+    for (size_t i = 0; i < PROF_TABLE_SIZE; i++)
+    {
+        prof_sample_t *smp = &prof_table[i];
+        if (smp->ptr == NULL)
+            continue;
+
+        n = snprintf(line, sizeof(line), "%d: %zu [1: %zu] @", smp->live, smp->live ? smp->size : 0, smp->size);
+        for (int f = 0; f < smp->depth; f++)
+            n += snprintf(line + n, sizeof(line) - n, " %p", smp->frames[f]);
+        line[n++] = '\n';
+        prof_write(fd, line, n);
+    }
+    pthread_mutex_unlock(&prof_lock);
+
+    prof_write(fd, "\nMAPPED_LIBRARIES:\n", 19);
+    int maps = open("/proc/self/maps", O_RDONLY);
+    if (maps >= 0)
+    {
+        ssize_t got;
+        while ((got = read(maps, line, sizeof(line))) > 0)
+            prof_write(fd, line, got);
+        close(maps);
+    }
+    return 0;
+}
+
+/*
+ * my_malloc_lock_all - take every allocator lock, e.g. before fork(), so
+ * no lock is held by a thread that will not exist on the other side.
+ * Order: arena list, arenas, profiler, heap zone; heap growth takes the
+ * zone lock while holding an arena lock, never the other way round.
+ */
+void my_malloc_lock_all(void)
+{
+    pthread_mutex_lock(&arena_list_lock);
+    for (int i = 0; i < narenas; i++)
+        pthread_mutex_lock(&arenas[i]->lock);
+    pthread_mutex_lock(&prof_lock);
+#ifdef COMPACT_TAGS
+    pthread_mutex_lock(&zone_lock);
+#endif
+}
+
+/* my_malloc_unlock_all - release the locks my_malloc_lock_all took, in reverse */
+void my_malloc_unlock_all(void)
+{
+#ifdef COMPACT_TAGS
+    pthread_mutex_unlock(&zone_lock);
+#endif
+    pthread_mutex_unlock(&prof_lock);
+    for (int i = narenas - 1; i >= 0; i--)
+        pthread_mutex_unlock(&arenas[i]->lock);
+    pthread_mutex_unlock(&arena_list_lock);
+}
+
+/*
+ * my_mallopt - adjust a tunable at run time (glibc mallopt style)
+ * Returns 1 on success, 0 on an unknown parameter or bad value
+ */
+int my_mallopt(int param, int value)
+{
+    switch (param)
+    {
+    case M_TCACHE_COUNT:
+        if (value < 0 || value > TCACHE_COUNT_MAX)
+            return 0;
+        /* Shrinking the depth takes effect lazily as each bin next overflows */
+        tcache_count = value;
+        return 1;
+    case M_ARENA_MAX:
+        if (value < 1 || value > ARENA_MAX)
+            return 0;
+        /* Existing arenas stay alive; new assignments use the first 'value' */
+        pthread_mutex_lock(&arena_list_lock);
+        arena_max = value;
+        pthread_mutex_unlock(&arena_list_lock);
+        return 1;
+    case M_MMAP_THRESHOLD:
+        if (value <= 0)
+            return 0;
+        mmap_threshold = (size_t)value;
+        return 1;
+    case M_TRIM_THRESHOLD:
+        if (value <= 0)
+            return 0;
+        trim_threshold = (size_t)value;
+        return 1;
+    case M_RELEASE_THRESHOLD:
+        if (value <= 0)
+            return 0;
+        release_threshold = (size_t)value;
+        return 1;
+    case M_MXFAST:
+        if (value < 0 || value > MXFAST_MAX)
+            return 0;
+        /* Flush every arena so no block is stranded in a bin the new limit excludes */
+        pthread_mutex_lock(&arena_list_lock);
+        fastbin_max = (value > 0) ? adjust_size((size_t)value) : 0;
+        for (int i = 0; i < narenas; i++)
+        {
+            pthread_mutex_lock(&arenas[i]->lock);
+            consolidate(arenas[i]);
+            pthread_mutex_unlock(&arenas[i]->lock);
+        }
+        pthread_mutex_unlock(&arena_list_lock);
+        return 1;
+    case M_PROFILE_INTERVAL:
+        if (value < 0 || (value > 0 && prof_init() == -1))
+            return 0;
+        /* Already-sampled blocks keep being tracked after profiling stops */
+        prof_interval = (size_t)value;
+        return 1;
+    case M_REMOTE_FREE:
+        if (value != 0 && value != 1)
+            return 0;
+        /* Blocks already queued are drained by the next malloc in their arena */
+        remote_frees = value;
+        return 1;
+    case M_SMALL_PAGES:
+        if (value < 0 || value > SPAGE_MAX)
+            return 0;
+        /* Objects already in pages keep going back to them */
+        spage_max = (value > 0) ? adjust_size((size_t)value) : 0;
+        return 1;
+    case M_HUGEPAGES:
+        if (value != 0 && value != 1)
+            return 0;
+        /* Existing heaps switch over as they commit their next granule */
+        use_hugepages = value;
+        return 1;
+    case M_GROW_MIN:
+        if (value <= 0 || (size_t)value > grow_max)
+            return 0;
+        /* Heaps with a policy of their own keep it */
+        grow_min = (size_t)value;
+        return 1;
+    case M_GROW_MAX:
+        if (value <= 0 || (size_t)value < grow_min)
+            return 0;
+        grow_max = (size_t)value;
+        return 1;
+    }
+    return 0;
+}
+
+/* Heap holding heap block 'ptr', or the calling thread's top heap for NULL; arena locked */
+static heap_t *heap_lock(void *ptr)
+{
+    arena_t *ar = (ptr != NULL) ? arena_for_ptr(ptr) : (thread_arena != NULL) ? thread_arena : &main_arena;
+
+    pthread_mutex_lock(&ar->lock);
+    if (ptr == NULL && ar->top == NULL && main_heap_init() == -1)
+    {
+        pthread_mutex_unlock(&ar->lock);
+        return NULL;
+    }
+    return (ptr != NULL) ? heap_for_ptr(ptr) : ar->top;
+}
+
+/*
+ * my_heap_growth - set the growth policy of the heap holding 'ptr' (a
+ * block from the arenas, not a mapped one), or of the calling thread's
+ * current heap if 'ptr' is NULL: each commit grows the heap by its
+ * committed size, but by at least 'min' and at most 'max' bytes, rounded
+ * to whole pages. 0 for either bound follows its my_mallopt default.
+ * Later heaps of the same arena inherit the policy.
+ * Returns 0, or -1 if min > max once the defaults are filled in, or there
+ * is no heap.
+ */
+int my_heap_growth(void *ptr, size_t min, size_t max)
+{
+    if ((min ? min : grow_min) > (max ? max : grow_max) || (ptr != NULL && IS_MMAPPED(GET_SHARED(HDRP(ptr)))))
+        return -1;
 
-    if (!next_alloc && (total_avail >= asize))
+    heap_t *h = heap_lock(ptr);
+    if (h == NULL)
+        return -1;
+    h->grow_min = min;
+    h->grow_max = max;
+    pthread_mutex_unlock(&h->ar->lock);
+    return 0;
+}
+
+/*
+ * my_heap_commits - mprotect calls that grew the heap holding 'ptr', or
+ * every heap since the process started if 'ptr' is NULL. A mapped block
+ * has no heap: 0.
+ */
+size_t my_heap_commits(void *ptr)
+{
+    if (ptr == NULL)
+        return atomic_load_explicit(&heap_commits, memory_order_relaxed);
+    if (IS_MMAPPED(GET_SHARED(HDRP(ptr))))
+        return 0;
+
+    heap_t *h = heap_for_ptr(ptr);
+    pthread_mutex_lock(&h->ar->lock);
+    size_t n = h->commits;
+    pthread_mutex_unlock(&h->ar->lock);
+    return n;
+}
+
+/*
+ * my_malloc - allocate a block with at least 'size' bytes of payload
+ * Returns pointer to payload, or NULL on failure
+ */
+ALLOC_TEXT void *my_malloc(size_t size)
+{
+    char *bp;
+    size_t asize;
+
+    if (size == 0)
+        return NULL;
+
+    if (size >= mmap_threshold)
+        return prof_hook(mmap_chunk(size, DWORD), size);
+
+    asize = adjust_size(size);
+
+    /* Fast path: a cached block of the exact size, no lock */
+    if ((bp = tcache_get(asize)) != NULL)
+        return prof_hook(bp, size);
+
+    arena_t *ar = arena_get();
+    bp = (asize <= spage_max) ? page_malloc(ar, asize) : NULL;
+    if (bp == NULL)
+        bp = malloc_block(ar, asize, NULL);
+    pthread_mutex_unlock(&ar->lock);
+    return prof_hook(bp, size);
+}
+
+/*
+ * my_calloc - allocate a zero-filled array of nmemb elements of 'size' bytes
+ * Fresh mappings and blocks still tagged ZEROED skip the memset (only the
+ * old free-list links are cleared), so untouched pages are never faulted in.
+ * Returns NULL on overflow or failure.
+ */
+ALLOC_TEXT void *my_calloc(size_t nmemb, size_t size)
+{
+    char *bp;
+    size_t bytes, asize, zeroed;
+
+    if (size != 0 && nmemb > SIZE_MAX / size)
+        return NULL;
+    bytes = nmemb * size;
+    if (bytes == 0)
+        return NULL;
+
+    if (bytes >= mmap_threshold)
+        return prof_hook(mmap_chunk(bytes, DWORD), bytes); /* anonymous mappings are zero-filled */
+
+    asize = adjust_size(bytes);
+
+    if ((bp = tcache_get(asize)) != NULL)
     {
-        /* Merge with free next block in-place */
-        delete_node(NXT_BLOCK(ptr));
+        memset(bp, 0, bytes);
+        return prof_hook(bp, bytes);
+    }
+
+    arena_t *ar = arena_get();
+    zeroed = 0;
+    bp = (asize <= spage_max) ? page_malloc(ar, asize) : NULL;
+    if (bp == NULL)
+        bp = malloc_block(ar, asize, &zeroed);
+    pthread_mutex_unlock(&ar->lock);
+
+    if (bp != NULL)
+        memset(bp, 0, zeroed ? MIN(bytes, 2 * WORD) : bytes);
+    return prof_hook(bp, bytes);
+}
+
+/*
+ * my_memalign - allocate 'size' bytes aligned to 'alignment'
+ * A non-power-of-two alignment is rounded up to the next power of two.
+ * Returns NULL on failure, with errno EINVAL for an alignment too large to
+ * honour and ENOMEM for an oversized request
+ */
+ALLOC_TEXT void *my_memalign(size_t alignment, size_t size)
+{
+    char *bp;
+
+    if (alignment <= DWORD)
+        return my_malloc(size);
+    if (size == 0)
+        return NULL;
+    if (alignment > SIZE_MAX / 4)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (size > SIZE_MAX / 2)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (alignment & (alignment - 1))
+        alignment = (size_t)1 << (64 - __builtin_clzl(alignment));
+
+    if (size + alignment >= mmap_threshold)
+        return prof_hook(mmap_chunk(size, alignment), size);
+
+    arena_t *ar = arena_get();
+    bp = memalign_block(ar, alignment, adjust_size(size));
+    pthread_mutex_unlock(&ar->lock);
+    return prof_hook(bp, size);
+}
+
+/*
+ * my_aligned_alloc - C11 aligned_alloc
+ * Returns NULL with errno EINVAL if 'alignment' is not a power of two
+ */
+ALLOC_TEXT void *my_aligned_alloc(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return my_memalign(alignment, size);
+}
+
+/*
+ * my_posix_memalign - POSIX posix_memalign
+ * Stores the block in *memptr. Returns 0, EINVAL for an alignment that is
+ * not a power-of-two multiple of sizeof(void *), or ENOMEM.
+ */
+ALLOC_TEXT int my_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *bp;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) || alignment == 0 || alignment > SIZE_MAX / 4)
+        return EINVAL;
+    if (size == 0)
+    {
+        *memptr = NULL;
+        return 0;
+    }
+    if ((bp = my_memalign(alignment, size)) == NULL)
+        return ENOMEM;
+    *memptr = bp;
+    return 0;
+}
+
+/* Run each of the 'got' blocks in out[] through the profiler, as my_malloc would. Returns got */
+ALLOC_TEXT static size_t batch_sample(void **out, size_t got, size_t size)
+{
+    if (prof_interval != 0)
+        for (size_t i = 0; i < got; i++)
+            prof_hook(out[i], size);
+    return got;
+}
+
+/*
+ * my_malloc_batch - allocate 'n' blocks of 'size' bytes each into out[]
+ * The arena lock is taken once, and each pass finds (or grows the heap by)
+ * one free block big enough for all remaining blocks and carves them out
+ * back to back. Returns the number of blocks allocated; out[] past that
+ * count is untouched.
+ */
+ALLOC_TEXT size_t my_malloc_batch(size_t n, size_t size, void **out)
+{
+    size_t got = 0;
+
+    if (size == 0)
+        return 0;
+
+    if (size >= mmap_threshold)
+    {
+        while (got < n && (out[got] = mmap_chunk(size, DWORD)) != NULL)
+            got++;
+        return batch_sample(out, got, size);
+    }
+
+    size_t asize = adjust_size(size);
+    /* Bound each pass so the run fits well inside one heap */
+    size_t max_run = (HEAP_SIZE / 2) / asize;
+    arena_t *ar = arena_get();
 
-        if ((total_avail - asize) >= (2 * DWORD))
+    if (ar->top == NULL && main_heap_init() == -1)
+    {
+        pthread_mutex_unlock(&ar->lock);
+        return 0;
+    }
+
+    while (got < n)
+    {
+        size_t want = MIN(n - got, max_run);
+        char *bp = find_fit(ar, want * asize);
+
+        if (bp == NULL)
+            bp = extend_heap(ar, MAX(want * asize, CHUNKSIZE) / WORD);
+        /* No room for the whole run: settle for any block that fits one */
+        if (bp == NULL && (bp = find_fit(ar, asize)) == NULL)
+            break;
+        got += carve_run(ar, bp, asize, want, out + got);
+    }
+    pthread_mutex_unlock(&ar->lock);
+    return batch_sample(out, got, size);
+}
+
+static int ptr_cmp(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)*(void *const *)a, y = (uintptr_t)*(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * my_free_batch - free 'n' blocks at once; NULL entries are skipped
+ * ptrs[] is sorted by address in place. Runs of physically adjacent blocks
+ * are merged into one block first, so each run costs a single coalesce,
+ * and each arena's lock is taken once per group of its blocks.
+ */
+void my_free_batch(size_t n, void **ptrs)
+{
+    arena_t *locked = NULL;
+
+    qsort(ptrs, n, sizeof(void *), ptr_cmp);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        char *bp = ptrs[i];
+
+        if (bp == NULL)
+            continue;
+        if (IS_MMAPPED(GET_SHARED(HDRP(bp))))
         {
-            PUT(HDRP(ptr), PACK(asize, 1));
-            PUT(FTRP(ptr), PACK(asize, 1));
+            if (GET(HDRP(bp)) & SAMPLED)
+                prof_free(bp, NULL);
+            munmap_chunk(bp);
+            continue;
+        }
 
-            void *remainder_ptr = NXT_BLOCK(ptr);
-            PUT(HDRP(remainder_ptr), PACK(total_avail - asize, 0));
-            PUT(FTRP(remainder_ptr), PACK(total_avail - asize, 0));
+        arena_t *ar = arena_for_ptr(bp);
+        if (ar != locked)
+        {
+            if (locked)
+                pthread_mutex_unlock(&locked->lock);
+            pthread_mutex_lock(&ar->lock);
+            locked = ar;
+        }
+        if (GET(HDRP(bp)) & SAMPLED)
+            prof_free(bp, ar);
 
-            insert_node(remainder_ptr);
+        /* Page objects are adjacent but never merge */
+        if (IS_PAGED(GET(HDRP(bp))))
+        {
+            page_free_local(ar, bp);
+            continue;
         }
-        else
+
+        /* Extend the run while the next pointer is the very next block */
+        char *last = bp;
+        size_t total = GET_SIZE(HDRP(bp));
+        while (i + 1 < n && ptrs[i + 1] == NXT_BLOCK(last))
         {
-            PUT(HDRP(ptr), PACK(total_avail, 1));
-            PUT(FTRP(ptr), PACK(total_avail, 1));
+            last = ptrs[++i];
+            if (GET(HDRP(last)) & SAMPLED)
+                prof_free(last, ar);
+            total += GET_SIZE(HDRP(last));
         }
 
-        return ptr;
+        PUT(HDRP(bp), PACK(total, GET_PREV_ALLOC(HDRP(bp)) | 1));
+        free_block(ar, bp);
     }
+    if (locked)
+        pthread_mutex_unlock(&locked->lock);
+}
 
-    /* Can't realloc in-place; allocate new block and copy data */
+/* Report heap misuse and stop, like glibc's "free(): invalid size" */
+static void malloc_abort(const char *msg)
+{
+    if (write(STDERR_FILENO, msg, strlen(msg)) < 0)
+        abort();
+    abort();
+}
+
+/*
+ * free_hdr - free block bp whose header word 'hdr' the caller already read
+ * Small blocks go to the thread cache first; others go back to the arena
+ * that owns them, whichever thread frees them.
+ */
+static void free_hdr(void *bp, uintptr_t hdr)
+{
+    if (hdr & SAMPLED)
+    {
+        prof_free(bp, NULL);
+        hdr &= ~(uintptr_t)SAMPLED;
+    }
+
+    if (IS_MMAPPED(hdr))
+    {
+        munmap_chunk(bp);
+        return;
+    }
+
+    arena_t *ar = arena_for_ptr(bp);
+    if (remote_frees && ar != thread_arena)
+    {
+        /* Not this thread's arena: neither its cache nor the owner's lock */
+        if (IS_PAGED(hdr))
+            page_free_remote(ar, bp);
+        else
+            remote_free(ar, bp);
+        return;
+    }
+
+    if (tcache_put(bp, hdr & ~(uintptr_t)(DWORD - 1)))
+        return;
+
+    pthread_mutex_lock(&ar->lock);
+    free_to_arena(ar, bp);
+    pthread_mutex_unlock(&ar->lock);
+}
+
+/*
+ * my_free - free a previously allocated block and coalesce if possible
+ */
+void my_free(void *bp)
+{
+    if (bp == NULL)
+        return;
+    free_hdr(bp, GET_SHARED(HDRP(bp)));
+}
+
+/*
+ * my_free_sized - free a block whose requested size the caller still knows
+ * (C++ sized delete). The size is checked against the header word that the
+ * free path loads anyway: a heap block must be what adjust_size(size) or
+ * an unsplit sliver more would have produced, and a mapped block or a
+ * page object (which keeps its slot when my_realloc shrinks it) must
+ * cover it. A mismatch, or a block that is not allocated, aborts instead
+ * of corrupting the free lists. 'size' may be anything up to
+ * my_malloc_usable_size.
+ */
+void my_free_sized(void *bp, size_t size)
+{
+    if (bp == NULL)
+        return;
+
+    uintptr_t hdr = GET_SHARED(HDRP(bp));
+    size_t bsize = hdr & ~(uintptr_t)(DWORD - 1);
+
+    if (!(hdr & 1))
+        malloc_abort("my_free_sized(): double free or corrupted header\n");
+    if (IS_MMAPPED(hdr))
+    {
+        if (size > mmap_usable_size(bp))
+            malloc_abort("my_free_sized(): invalid size\n");
+    }
+    else if (IS_PAGED(hdr))
+    {
+        if (size > bsize - WORD)
+            malloc_abort("my_free_sized(): invalid size\n");
+    }
+    else if (size > bsize || adjust_size(size) > bsize || bsize - adjust_size(size) >= MIN_BLOCK)
+    {
+        malloc_abort("my_free_sized(): invalid size\n");
+    }
+    free_hdr(bp, hdr);
+}
+
+/*
+ * my_malloc_usable_size - payload bytes actually available at bp
+ * At least the requested size; the caller may use all of it, e.g. to grow
+ * a container into the slack place() left without calling my_realloc.
+ */
+size_t my_malloc_usable_size(void *bp)
+{
+    if (bp == NULL)
+        return 0;
+
+    uintptr_t hdr = GET_SHARED(HDRP(bp));
+    if (IS_MMAPPED(hdr))
+        return mmap_usable_size(bp);
+    return (hdr & ~(uintptr_t)(DWORD - 1)) - WORD;
+}
+
+/*
+ * mmap_realloc - resize a mapped block
+ * While the request stays large, mremap resizes the mapping: shrinking
+ * unmaps the tail, and growing extends it in place or moves the page tables
+ * elsewhere, so no payload bytes are copied. Only a block that shrinks
+ * below the threshold is copied into the arenas.
+ */
+ALLOC_TEXT static void *mmap_realloc(void *ptr, size_t size)
+{
+    size_t usable = mmap_usable_size(ptr);
+    uintptr_t sampled = GET_SHARED(HDRP(ptr)) & SAMPLED;
+
+    if (size >= mmap_threshold)
+    {
+        size_t offset = MMAP_OFFSET(ptr);
+        size_t old_len = GET_SIZE(HDRP(ptr));
+        size_t new_len = page_align(size + offset);
+
+        if (new_len == old_len)
+            return sampled ? prof_move(ptr, ptr, size) : ptr;
+        if ((tag_t)new_len != new_len)
+            return NULL;
+
+        char *base = mremap((char *)ptr - offset, old_len, new_len, MREMAP_MAYMOVE);
+        if (base != MAP_FAILED)
+        {
+            char *bp = base + offset;
+            PUT(HDRP(bp), PACK(new_len, MMAPPED | 1));
+            return sampled ? prof_move(ptr, bp, size) : bp;
+        }
+        /* Kernel refused (e.g. no room to grow): fall back to a copy */
+    }
+
+    void *new_ptr = my_malloc(size);
+    if (new_ptr == NULL)
+        return NULL;
+
+    memcpy(new_ptr, ptr, (size < usable) ? size : usable);
+    if (sampled)
+        prof_free(ptr, NULL);
+    munmap_chunk(ptr);
+    return new_ptr;
+}
+
+/* Move a heap block of 'old_size' bytes to a new 'size'-byte allocation */
+ALLOC_TEXT static void *realloc_copy(void *ptr, size_t size, size_t old_size)
+{
     void *new_ptr = my_malloc(size);
     if (new_ptr == NULL)
         return NULL;
 
     /* Copy old_size minus header; cap at requested size to avoid overflow */
-    size_t copy_size = old_size - DWORD;
+    size_t copy_size = old_size - WORD;
 
     if (size < copy_size)
         copy_size = size;
@@ -355,4 +2475,149 @@ void *my_realloc(void *ptr, size_t size)
     my_free(ptr);
 
     return new_ptr;
-}
\ No newline at end of file
+}
+
+/*
+ * my_realloc - resize a block, in place when possible
+ * Growth first absorbs a free next block (no copy), then merges with a free
+ * previous block and memmoves the payload down; only when neither has
+ * room does it allocate elsewhere and copy. Neighbouring blocks are only
+ * inspected under the owning arena's lock; the copy fallback goes through
+ * the public my_malloc/my_free so it can use the thread cache.
+ */
+ALLOC_TEXT void *my_realloc(void *ptr, size_t size)
+{
+    if (size == 0)
+    {
+        my_free(ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL)
+    {
+        return my_malloc(size);
+    }
+
+    /* adjust_size and the mapping length would wrap: fail, keeping the block */
+    if (size > SIZE_MAX - DWORD - page_align(1))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /*
+     * A sample ends only once the resize succeeds: the copy paths free the
+     * block through my_free, and the others hand it to prof_move.
+     */
+    uintptr_t hdr = GET_SHARED(HDRP(ptr));
+    uintptr_t sampled = hdr & SAMPLED;
+    if (IS_MMAPPED(hdr))
+        return mmap_realloc(ptr, size);
+
+    size_t asize = adjust_size(size);
+    size_t old_size = hdr & ~(uintptr_t)(DWORD - 1);
+    arena_t *ar = arena_for_ptr(ptr);
+
+    /* Page objects have a fixed size and no footer: keep the slot or move */
+    if (IS_PAGED(hdr))
+    {
+        if (asize > old_size)
+            return realloc_copy(ptr, size, old_size);
+        return sampled ? prof_move(ptr, ptr, size) : ptr;
+    }
+
+    if (asize <= old_size)
+    {
+        /* Shrink or no change: split if fragment is large enough */
+        if ((old_size - asize) >= MIN_BLOCK)
+        {
+            pthread_mutex_lock(&ar->lock);
+            PUT(HDRP(ptr), PACK(asize, GET_PREV_ALLOC(HDRP(ptr)) | 1));
+
+            void *next_ptr = NXT_BLOCK(ptr);
+            PUT(HDRP(next_ptr), PACK(old_size - asize, PREV_ALLOC));
+            PUT(FTRP(next_ptr), PACK(old_size - asize, PREV_ALLOC));
+
+            coalesce(ar, next_ptr);
+            pthread_mutex_unlock(&ar->lock);
+        }
+        return sampled ? prof_move(ptr, ptr, size) : ptr;
+    }
+
+    pthread_mutex_lock(&ar->lock);
+
+    /* Need to grow: try to use free adjacent block without moving data */
+    size_t next_alloc = GET_ALLOC(HDRP(NXT_BLOCK(ptr)));
+    size_t next_size = GET_SIZE(HDRP(NXT_BLOCK(ptr)));
+    size_t total_avail = old_size + next_size;
+
+    if (!next_alloc && (total_avail >= asize))
+    {
+        /* Merge with free next block in-place */
+        delete_node(ar, NXT_BLOCK(ptr));
+
+        size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
+        if ((total_avail - asize) >= MIN_BLOCK)
+        {
+            PUT(HDRP(ptr), PACK(asize, prev_alloc | 1));
+
+            /* The remainder's right neighbour already has PREV_ALLOC clear: it followed the free next block */
+            void *remainder_ptr = NXT_BLOCK(ptr);
+            PUT(HDRP(remainder_ptr), PACK(total_avail - asize, PREV_ALLOC));
+            PUT(FTRP(remainder_ptr), PACK(total_avail - asize, PREV_ALLOC));
+
+            insert_node(ar, remainder_ptr);
+        }
+        else
+        {
+            PUT(HDRP(ptr), PACK(total_avail, prev_alloc | 1));
+            SET_PREV_ALLOC(NXT_BLOCK(ptr));
+        }
+
+        pthread_mutex_unlock(&ar->lock);
+        return sampled ? prof_move(ptr, ptr, size) : ptr;
+    }
+
+    /* Next block alone is too small: slide the payload down into a free predecessor */
+    if (!GET_PREV_ALLOC(HDRP(ptr)))
+    {
+        char *prev = PRV_BLOCK(ptr);
+        total_avail = GET_SIZE(HDRP(prev)) + old_size + (next_alloc ? 0 : next_size);
+
+        if (total_avail >= asize)
+        {
+            /* Unlink first: the links live in payload bytes the move overwrites */
+            delete_node(ar, prev);
+            if (!next_alloc)
+                delete_node(ar, NXT_BLOCK(ptr));
+
+            memmove(prev, ptr, old_size - WORD);
+
+            /* prev was free, so the block before it is allocated */
+            if ((total_avail - asize) >= MIN_BLOCK)
+            {
+                PUT(HDRP(prev), PACK(asize, PREV_ALLOC | 1));
+
+                /* Remainder's right neighbour is allocated: any free one was absorbed */
+                void *remainder_ptr = NXT_BLOCK(prev);
+                PUT(HDRP(remainder_ptr), PACK(total_avail - asize, PREV_ALLOC));
+                PUT(FTRP(remainder_ptr), PACK(total_avail - asize, PREV_ALLOC));
+                CLR_PREV_ALLOC(NXT_BLOCK(remainder_ptr));
+
+                insert_node(ar, remainder_ptr);
+            }
+            else
+            {
+                PUT(HDRP(prev), PACK(total_avail, PREV_ALLOC | 1));
+                SET_PREV_ALLOC(NXT_BLOCK(prev));
+            }
+
+            pthread_mutex_unlock(&ar->lock);
+            return sampled ? prof_move(ptr, prev, size) : prev;
+        }
+    }
+    pthread_mutex_unlock(&ar->lock);
+
+    /* Can't realloc in-place; allocate new block and copy data */
+    return realloc_copy(ptr, size, old_size);
+}
@@ -1,7 +1,33 @@
+/*
+ * Random alloc/free churn benchmark.
+ *
+ * Segregated lists vs. the old single free list:
+ *   gcc -O2 benchmark.c -o bench                    (segregated size classes)
+ *   gcc -O2 -DNUM_CLASSES=1 benchmark.c -o bench    (one list, plain first fit)
+ *
+ * A second phase mixes in short-lived large buffers and compares the
+ * mmap path against routing them through the arena heap. A third grows
+ * one buffer to 128 MB with my_realloc (mremap) versus malloc + memcpy.
+ * The last allocates and frees rounds of same-sized nodes one at a time
+ * versus through my_malloc_batch / my_free_batch, and the fast-bin phase
+ * frees and re-mallocs blocks between free holes with and without
+ * deferred coalescing. The node rounds are then repeated with the heap
+ * profiler sampling, to show what it costs. Finally a 256 MB linked list
+ * of small nodes is walked in random order with 4 KB and with huge-page
+ * heap growth, counting dTLB misses where perf events are available.
+ * The locality phase fragments the heap, builds a list of small nodes
+ * interleaved with other sizes, and walks it in allocation order, with and
+ * without small-object pages.
+ */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include "alloc.c"
 
@@ -9,13 +35,292 @@
 #define MAX_ALLOC_SIZE 1024
 #define HEAP_SIZE_LIMIT (1024 * 1024 * 50) // 50 MB simulated
 
+#define MIXED_OPS 20000
+#define LARGE_PERCENT 2                 // share of allocations that are large
+#define LARGE_MIN (256 * 1024)
+#define LARGE_MAX (2 * 1024 * 1024)
+
+#define BUF_STEP (4 * 1024 * 1024)      // growing-buffer phase: 4 MB steps ...
+#define BUF_MAX (128 * 1024 * 1024)     // ... up to 128 MB
+
+#define NODE_ROUNDS 2000                // batch phase: rounds of ...
+#define NODES_PER_ROUND 1000            // ... this many same-sized nodes
+#define NODE_SIZE 48
+
+#define HOT_OPS 2000000                 // fast-bin phase: free/malloc pairs between free holes
+
+#define PROFILE_INTERVAL (512 * 1024)   // profiler phase: mean bytes between samples
+
+#define WALK_NODES (4 * 1024 * 1024)    // huge-page phase: nodes in a shuffled list ...
+#define WALK_NODE_SIZE 48               // ... of 64-byte blocks (256 MB)
+#define WALK_STEPS (16 * 1024 * 1024)
+
+#define LOCAL_CHURN 200000             // locality phase: blocks allocated then half freed ...
+#define LOCAL_NODES (1024 * 1024)       // ... before building a list of 48-byte nodes
+#define LOCAL_PASSES 20
+
 void *pointers[NUM_OPS];
 int ptr_status[NUM_OPS]; // 0 = free, 1 = allocated
 
+// Resident set size in KB, from /proc/self/statm
+long rss_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Mixed small/large workload; returns elapsed seconds and reports heap growth
+double run_mixed(size_t *heap_bytes)
+{
+    void *live[256] = {0};
+    srand(7);
+    mminit();
+
+    clock_t start = clock();
+    for (int i = 0; i < MIXED_OPS; i++)
+    {
+        int k = rand() % 256;
+        if (live[k])
+        {
+            my_free(live[k]);
+            live[k] = NULL;
+            continue;
+        }
+
+        size_t size;
+        if (rand() % 100 < LARGE_PERCENT)
+            size = LARGE_MIN + rand() % (LARGE_MAX - LARGE_MIN);
+        else
+            size = (rand() % MAX_ALLOC_SIZE) + 1;
+
+        live[k] = my_malloc(size);
+        if (live[k])
+            *(int *)live[k] = 12345;
+    }
+    clock_t end = clock();
+
+    *heap_bytes = 0;
+    for (heap_t *h = main_arena.top; h != NULL; h = h->prev)
+        *heap_bytes += h->hi - (char *)h;
+    for (int k = 0; k < 256; k++)
+        my_free(live[k]);
+    return (double)(end - start) / CLOCKS_PER_SEC;
+}
+
+// Grow one buffer BUF_STEP at a time, via my_realloc or via malloc + memcpy + free
+double run_grow(int use_realloc)
+{
+    size_t size = BUF_STEP;
+    char *buf = my_malloc(size);
+    memset(buf, 1, size);
+
+    clock_t start = clock();
+    for (size += BUF_STEP; size <= BUF_MAX; size += BUF_STEP)
+    {
+        char *next;
+        if (use_realloc)
+        {
+            next = my_realloc(buf, size);
+        }
+        else
+        {
+            next = my_malloc(size);
+            memcpy(next, buf, size - BUF_STEP);
+            my_free(buf);
+        }
+        buf = next;
+        buf[size - 1] = 1;
+    }
+    clock_t end = clock();
+
+    my_free(buf);
+    return (double)(end - start) / CLOCKS_PER_SEC;
+}
+
+// Allocate and free NODES_PER_ROUND nodes per round, one by one or as a batch
+double run_nodes(int use_batch)
+{
+    static void *nodes[NODES_PER_ROUND];
+    mminit();
+
+    clock_t start = clock();
+    for (int r = 0; r < NODE_ROUNDS; r++)
+    {
+        if (use_batch)
+        {
+            my_malloc_batch(NODES_PER_ROUND, NODE_SIZE, nodes);
+        }
+        else
+        {
+            for (int i = 0; i < NODES_PER_ROUND; i++)
+                nodes[i] = my_malloc(NODE_SIZE);
+        }
+
+        for (int i = 0; i < NODES_PER_ROUND; i++)
+            *(int *)nodes[i] = i;
+
+        if (use_batch)
+        {
+            my_free_batch(NODES_PER_ROUND, nodes);
+        }
+        else
+        {
+            for (int i = 0; i < NODES_PER_ROUND; i++)
+                my_free(nodes[i]);
+        }
+    }
+    clock_t end = clock();
+
+    return (double)(end - start) / CLOCKS_PER_SEC;
+}
+
+// Free/malloc the same size next to free neighbours, with the thread cache off
+double run_hot_pairs(int mxfast)
+{
+    static void *blocks[1024];
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+    my_mallopt(M_MXFAST, mxfast);
+
+    for (int i = 0; i < 1024; i++)
+        blocks[i] = my_malloc(64);
+    for (int i = 0; i < 1024; i += 2)
+        my_free(blocks[i]); // holes on both sides of every odd block
+
+    clock_t start = clock();
+    for (int i = 0; i < HOT_OPS; i++)
+    {
+        int k = (i % 511) * 2 + 1;
+        my_free(blocks[k]);
+        blocks[k] = my_malloc(64);
+    }
+    clock_t end = clock();
+
+    my_mallopt(M_MXFAST, 0);
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+    return (double)(end - start) / CLOCKS_PER_SEC;
+}
+
+// Counter for user-space dTLB load misses on this thread, or -1 if perf events are unavailable
+int dtlb_counter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Chase a randomly ordered list through WALK_NODES heap nodes; reports dTLB misses (-1 if unknown)
+double run_walk(int hugepages, long long *misses)
+{
+    static void **nodes[WALK_NODES];
+    my_mallopt(M_HUGEPAGES, hugepages);
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    for (int i = 0; i < WALK_NODES; i++)
+        nodes[i] = my_malloc(WALK_NODE_SIZE);
+
+    // Link the nodes into one cycle in shuffled order
+    srand(11);
+    for (int i = WALK_NODES - 1; i > 0; i--)
+    {
+        int j = ((unsigned)rand() * (RAND_MAX + 1u) + (unsigned)rand()) % (unsigned)(i + 1);
+        void **tmp = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = tmp;
+    }
+    for (int i = 0; i < WALK_NODES; i++)
+        *nodes[i] = nodes[(i + 1) % WALK_NODES];
+
+    int fd = dtlb_counter();
+    if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    clock_t start = clock();
+    void **p = nodes[0];
+    for (int i = 0; i < WALK_STEPS; i++)
+        p = *p;
+    clock_t end = clock();
+    *misses = -1;
+    if (fd >= 0)
+    {
+        if (read(fd, misses, sizeof(*misses)) != sizeof(*misses))
+            *misses = -1;
+        close(fd);
+    }
+    assert(p != NULL);
+
+    mminit(); // drops every heap at once
+    my_mallopt(M_HUGEPAGES, 0);
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+    return (double)(end - start) / CLOCKS_PER_SEC;
+}
+
+// Walk a list built on a fragmented heap, in allocation order; pages > 0 turns on M_SMALL_PAGES
+double run_locality(int pages)
+{
+    static void *churn[LOCAL_CHURN];
+    mminit();
+    my_mallopt(M_SMALL_PAGES, pages);
+
+    srand(5);
+    for (int i = 0; i < LOCAL_CHURN; i++)
+        churn[i] = my_malloc(16 + rand() % 496);
+    for (int i = 0; i < LOCAL_CHURN; i++)
+    {
+        if (rand() % 2)
+        {
+            my_free(churn[i]);
+            churn[i] = NULL;
+        }
+    }
+
+    // Each node is followed by an allocation of another size, as in real code
+    void **head = NULL, **tail = NULL;
+    for (int i = 0; i < LOCAL_NODES; i++)
+    {
+        void **node = my_malloc(NODE_SIZE);
+        *node = NULL;
+        if (tail)
+            *tail = node;
+        else
+            head = node;
+        tail = node;
+        my_malloc(16 + rand() % 240);
+    }
+
+    clock_t start = clock();
+    long count = 0;
+    for (int pass = 0; pass < LOCAL_PASSES; pass++)
+    {
+        for (void **p = head; p != NULL; p = *p)
+            count++;
+    }
+    clock_t end = clock();
+    assert(count == (long)LOCAL_NODES * LOCAL_PASSES);
+
+    mminit(); // drops every heap at once
+    my_mallopt(M_SMALL_PAGES, 0);
+    return (double)(end - start) / CLOCKS_PER_SEC;
+}
+
 int main()
 {
     printf("Starting Benchmark...\n");
     printf("Total Operations: %d\n", NUM_OPS);
+    printf("Free List Size Classes: %d\n", NUM_CLASSES);
 
     // Initialize
     if (mminit() == -1)
@@ -87,6 +392,85 @@ int main()
     printf("Successful Allocations: %d\n", successful_allocs);
     printf("Time Taken: %f seconds\n", time_spent);
     printf("Throughput: %.0f ops/sec\n", NUM_OPS / time_spent);
+    printf("Heap commits: %zu mprotect calls\n", my_heap_commits(NULL));
+    printf("--------------------------------------------\n");
+
+    // Free everything still live and see how much memory goes back to the OS
+    long rss_live = rss_kb();
+    for (int i = 0; i < NUM_OPS; i++)
+    {
+        if (ptr_status[i] == 1)
+        {
+            my_free(pointers[i]);
+            ptr_status[i] = 0;
+        }
+    }
+    printf("RSS with live blocks: %ld KB\n", rss_live);
+    printf("RSS after freeing all: %ld KB\n", rss_kb());
+    printf("--------------------------------------------\n");
+
+    size_t heap_mapped, heap_unmapped;
+    double t_mapped = run_mixed(&heap_mapped);
+    my_mallopt(M_MMAP_THRESHOLD, 0x7fffffff); // large blocks through the heap
+    double t_unmapped = run_mixed(&heap_unmapped);
+    my_mallopt(M_MMAP_THRESHOLD, MMAP_THRESHOLD);
+
+    printf("Mixed Small/Large (%d ops, %d%% >= 256 KB)\n", MIXED_OPS, LARGE_PERCENT);
+    printf("  mmap path:  %f seconds, heap %zu KB\n", t_mapped, heap_mapped / 1024);
+    printf("  heap only:  %f seconds, heap %zu KB\n", t_unmapped, heap_unmapped / 1024);
+    printf("--------------------------------------------\n");
+
+    double t_mremap = run_grow(1);
+    double t_copy = run_grow(0);
+    printf("Growing Buffer (%d MB -> %d MB in %d MB steps)\n", BUF_STEP >> 20, BUF_MAX >> 20, BUF_STEP >> 20);
+    printf("  realloc (mremap): %f seconds\n", t_mremap);
+    printf("  malloc + copy:    %f seconds\n", t_copy);
+    printf("--------------------------------------------\n");
+
+    double t_single = run_nodes(0);
+    double t_batch = run_nodes(1);
+    printf("Same-Size Nodes (%d rounds x %d x %d bytes)\n", NODE_ROUNDS, NODES_PER_ROUND, NODE_SIZE);
+    printf("  one at a time:  %f seconds\n", t_single);
+    printf("  batch:          %f seconds\n", t_batch);
+    printf("--------------------------------------------\n");
+
+    double t_coalesce = run_hot_pairs(0);
+    double t_fast = run_hot_pairs(MXFAST_MAX);
+    printf("Hot Free/Malloc Pairs (%d, no thread cache)\n", HOT_OPS);
+    printf("  eager coalescing: %f seconds\n", t_coalesce);
+    printf("  fast bins:        %f seconds\n", t_fast);
+    printf("--------------------------------------------\n");
+
+    double t_unprofiled = run_nodes(0);
+    my_mallopt(M_PROFILE_INTERVAL, PROFILE_INTERVAL);
+    double t_profiled = run_nodes(0);
+    my_mallopt(M_PROFILE_INTERVAL, 0);
+    printf("Heap Profiler (node rounds, one sample per %d KB)\n", PROFILE_INTERVAL >> 10);
+    printf("  off:      %f seconds\n", t_unprofiled);
+    printf("  sampling: %f seconds\n", t_profiled);
+    printf("--------------------------------------------\n");
+
+    long long small_misses, huge_misses;
+    double t_small = run_walk(0, &small_misses);
+    double t_huge = run_walk(1, &huge_misses);
+    printf("Random Walk (%d M nodes of %d bytes, %d M steps)\n", WALK_NODES >> 20, WALK_NODE_SIZE, WALK_STEPS >> 20);
+    if (small_misses >= 0 && huge_misses >= 0)
+    {
+        printf("  4 KB pages:   %f seconds, %lld dTLB misses\n", t_small, small_misses);
+        printf("  huge pages:   %f seconds, %lld dTLB misses\n", t_huge, huge_misses);
+    }
+    else
+    {
+        printf("  4 KB pages:   %f seconds (dTLB counter unavailable)\n", t_small);
+        printf("  huge pages:   %f seconds\n", t_huge);
+    }
+    printf("--------------------------------------------\n");
+
+    double t_lists = run_locality(0);
+    double t_pages = run_locality(SPAGE_MAX);
+    printf("List Locality (%d K nodes of %d bytes on a fragmented heap, %d passes)\n", LOCAL_NODES >> 10, NODE_SIZE, LOCAL_PASSES);
+    printf("  free lists:  %f seconds\n", t_lists);
+    printf("  pages:       %f seconds\n", t_pages);
     printf("--------------------------------------------\n");
 
     return 0;
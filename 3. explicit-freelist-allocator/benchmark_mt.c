@@ -0,0 +1,173 @@
+/*
+ * Multi-threaded churn benchmark.
+ *
+ *   gcc -O2 -pthread benchmark_mt.c -o bench_mt
+ *   ./bench_mt [threads]
+ *
+ * Each thread runs the same random small-object alloc/free mix against
+ * the shared allocator: first with one arena and no thread cache, then
+ * with multiple arenas, then with arenas plus the thread cache.
+ * A last phase pairs producer threads that allocate with consumer threads
+ * that free, through a ring buffer, with the locked cross-thread free
+ * path and with lock-free remote frees.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "alloc.c"
+
+#define OPS_PER_THREAD 200000
+#define SLOTS_PER_THREAD 256
+#define MAX_ALLOC_SIZE 512
+#define MAX_THREADS 64
+
+#define PIPE_ITEMS 1000000                // producer/consumer phase: blocks per pair
+#define PIPE_RING 256                     // ring slots between a producer and its consumer
+
+void *worker(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    void *slots[SLOTS_PER_THREAD] = {0};
+
+    for (int i = 0; i < OPS_PER_THREAD; i++)
+    {
+        int k = rand_r(&seed) % SLOTS_PER_THREAD;
+        if (slots[k])
+        {
+            my_free(slots[k]);
+            slots[k] = NULL;
+        }
+        else
+        {
+            slots[k] = my_malloc((rand_r(&seed) % MAX_ALLOC_SIZE) + 1);
+            if (slots[k])
+                *(int *)slots[k] = 12345;
+        }
+    }
+    for (int k = 0; k < SLOTS_PER_THREAD; k++)
+        my_free(slots[k]);
+    return NULL;
+}
+
+typedef struct pipe_t
+{
+    void *ring[PIPE_RING];
+} pipe_t;
+
+void *producer(void *arg)
+{
+    pipe_t *pp = arg;
+    unsigned seed = (unsigned)(uintptr_t)arg;
+
+    for (long i = 0; i <= PIPE_ITEMS; i++)
+    {
+        void *p = (i < PIPE_ITEMS) ? my_malloc((rand_r(&seed) % MAX_ALLOC_SIZE) + 1) : (void *)1;
+        if (i < PIPE_ITEMS)
+            *(int *)p = 12345;
+        while (__atomic_load_n(&pp->ring[i % PIPE_RING], __ATOMIC_ACQUIRE) != NULL)
+            sched_yield();
+        __atomic_store_n(&pp->ring[i % PIPE_RING], p, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+void *consumer(void *arg)
+{
+    pipe_t *pp = arg;
+
+    for (long i = 0;; i++)
+    {
+        void *p;
+        while ((p = __atomic_exchange_n(&pp->ring[i % PIPE_RING], NULL, __ATOMIC_ACQUIRE)) == NULL)
+            sched_yield();
+        if (p == (void *)1)
+            return NULL;
+        my_free(p);
+    }
+}
+
+// npairs producer/consumer pairs; every block is freed by a thread other than its allocator
+double run_pipeline(int npairs)
+{
+    static pipe_t pipes[MAX_THREADS / 2];
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+
+    memset(pipes, 0, sizeof(pipes));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < npairs; i++)
+    {
+        pthread_create(&threads[2 * i], NULL, producer, &pipes[i]);
+        pthread_create(&threads[2 * i + 1], NULL, consumer, &pipes[i]);
+    }
+    for (int i = 0; i < 2 * npairs; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+double run(int nthreads)
+{
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < nthreads; i++)
+        pthread_create(&threads[i], NULL, worker, (void *)(i + 1));
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads = (argc > 1) ? atoi(argv[1]) : 8;
+    if (nthreads < 1 || nthreads > MAX_THREADS)
+        nthreads = 8;
+
+    printf("Starting Multi-Threaded Benchmark...\n");
+    printf("Threads: %d x %d ops\n", nthreads, OPS_PER_THREAD);
+
+    if (mminit() == -1)
+    {
+        printf("Heap init failed\n");
+        return 1;
+    }
+
+    my_mallopt(M_TCACHE_COUNT, 0);
+    my_mallopt(M_ARENA_MAX, 1);
+    double t_locked = run(nthreads);
+
+    my_mallopt(M_ARENA_MAX, ARENA_MAX);
+    double t_arenas = run(nthreads);
+
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+    double t_cached = run(nthreads);
+
+    double total_ops = (double)nthreads * OPS_PER_THREAD;
+    printf("--------------------------------------------\n");
+    printf("Single arena:   %f seconds (%.0f ops/sec)\n", t_locked, total_ops / t_locked);
+    printf("Arenas (%2d):    %f seconds (%.0f ops/sec)\n", narenas, t_arenas, total_ops / t_arenas);
+    printf("Arenas + cache: %f seconds (%.0f ops/sec)\n", t_cached, total_ops / t_cached);
+    printf("--------------------------------------------\n");
+
+    int npairs = (nthreads + 1) / 2;
+    my_mallopt(M_REMOTE_FREE, 0);
+    double t_locked_pipe = run_pipeline(npairs);
+    my_mallopt(M_REMOTE_FREE, 1);
+    double t_remote_pipe = run_pipeline(npairs);
+    printf("Producer/consumer (%d pairs x %d blocks)\n", npairs, PIPE_ITEMS);
+    printf("  locked frees: %f seconds\n", t_locked_pipe);
+    printf("  remote frees: %f seconds\n", t_remote_pipe);
+    printf("--------------------------------------------\n");
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * LD_PRELOAD shim: the standard malloc family backed by the explicit allocator.
+ *
+ *   gcc -O2 -fPIC -shared -pthread -ftls-model=initial-exec preload.c -o libexplicit.so
+ *   LD_PRELOAD=./libexplicit.so ls -l
+ *   LD_PRELOAD=./libexplicit.so python3 -c 'print(sum(range(10**6)))'
+ *
+ * Interposition notes:
+ * - Nothing on the allocation path calls back into libc's malloc: state is
+ *   static, locks use PTHREAD_MUTEX_INITIALIZER and the heap comes straight
+ *   from mmap. initial-exec TLS keeps __tls_get_addr (which may allocate)
+ *   off the thread-cache path.
+ * - fork: every allocator lock (arenas, profiler, heap zone) is taken
+ *   before the fork and released on both sides, so the child never
+ *   inherits a lock held by a thread that no longer exists.
+ * - malloc(0) and realloc(NULL, 0) return a unique minimum-size block, as
+ *   glibc does, since programs treat NULL there as out of memory.
+ * - Every failure that returns NULL sets errno (ENOMEM, or EINVAL for a
+ *   bad alignment), as callers like strerror(errno) after a NULL expect.
+ *   posix_memalign only returns its error code and leaves errno alone.
+ * - The wrappers are ALLOC_TEXT, so heap profile samples name the
+ *   application's call site rather than the shim.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include "alloc.c"
+
+/* --- FORK SAFETY --- */
+
+static void fork_prepare(void)
+{
+    my_malloc_lock_all();
+}
+
+static void fork_release(void)
+{
+    my_malloc_unlock_all();
+}
+
+__attribute__((constructor)) static void preload_init(void)
+{
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+/* --- MALLOC FAMILY --- */
+
+/* The allocator only sets errno on some failure paths */
+static void *enomem_if_null(void *ptr)
+{
+    if (ptr == NULL)
+        errno = ENOMEM;
+    return ptr;
+}
+
+/*
+ * Finish an aligned call made with errno cleared: keep the EINVAL the
+ * allocator sets for a bad alignment, report any other failure as ENOMEM,
+ * and restore the caller's errno on success
+ */
+static void *aligned_result(void *ptr, int saved)
+{
+    if (ptr != NULL)
+        errno = saved;
+    else if (errno != EINVAL)
+        errno = ENOMEM;
+    return ptr;
+}
+
+ALLOC_TEXT void *malloc(size_t size)
+{
+    return enomem_if_null(my_malloc(size ? size : 1));
+}
+
+void free(void *ptr)
+{
+    my_free(ptr);
+}
+
+ALLOC_TEXT void *calloc(size_t nmemb, size_t size)
+{
+    if (nmemb == 0 || size == 0)
+        return enomem_if_null(my_malloc(1));
+    return enomem_if_null(my_calloc(nmemb, size));
+}
+
+ALLOC_TEXT void *realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return enomem_if_null(my_malloc(size ? size : 1));
+    if (size == 0)
+        return my_realloc(ptr, 0); /* frees ptr: NULL is not a failure */
+    return enomem_if_null(my_realloc(ptr, size));
+}
+
+/* POSIX: errors only through the return value, errno untouched */
+ALLOC_TEXT int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    int saved = errno;
+    int err = my_posix_memalign(memptr, alignment, size ? size : 1);
+
+    errno = saved;
+    return err;
+}
+
+ALLOC_TEXT void *aligned_alloc(size_t alignment, size_t size)
+{
+    int saved = errno;
+
+    errno = 0;
+    return aligned_result(my_aligned_alloc(alignment, size ? size : 1), saved);
+}
+
+ALLOC_TEXT void *memalign(size_t alignment, size_t size)
+{
+    int saved = errno;
+
+    errno = 0;
+    return aligned_result(my_memalign(alignment, size ? size : 1), saved);
+}
+
+ALLOC_TEXT void *valloc(size_t size)
+{
+    return enomem_if_null(my_memalign(page_align(1), size ? size : 1));
+}
+
+ALLOC_TEXT void *pvalloc(size_t size)
+{
+    if (size > SIZE_MAX - page_align(1))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return enomem_if_null(my_memalign(page_align(1), page_align(size ? size : 1)));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    return my_malloc_usable_size(ptr);
+}
@@ -1,10 +1,15 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 /* --- WHITE BOX TESTING --- */
-// Include the source directly to access static variables (heap_list_p, free_list_p)
+// Include the source directly to access static variables (main_arena, arenas)
 // and internal macros (HDRP, NXT_BLOCK, etc.)
 #include "alloc.c"
 
@@ -33,59 +38,86 @@ int tests_total = 0;
     } while (0)
 
 /* --- INTEGRITY CHECKER --- */
-// Validates the Linked List Structure
-int check_list_integrity()
-{
-    char *bp = free_list_p;
-    char *prev = NULL;
-    int limit = 0;
+// Root of the class list a free block of this size belongs to
+#define CLASS_ROOT(bp) (arena_for_ptr(bp)->seg_lists[get_class(GET_SIZE(HDRP(bp)))])
 
-    // 1. Check Root
-    if (free_list_p != NULL && (GET_ALLOC(HDRP(free_list_p)) == 1))
+// Validates the Linked List Structure of every size class in one arena
+int check_arena_integrity(arena_t *ar)
+{
+    for (int cls = 0; cls < NUM_CLASSES; cls++)
     {
-        printf("ERROR: Root of free list is marked ALLOCATED!\n");
-        return 0;
-    }
+        char *bp = ar->seg_lists[cls];
+        char *prev = NULL;
+        int limit = 0;
 
-    while (bp != NULL)
-    {
-        limit++;
-        if (limit > 10000)
+        while (bp != NULL)
         {
-            printf("ERROR: Infinite loop in free list.\n");
-            return 0;
-        }
+            limit++;
+            if (limit > 10000)
+            {
+                printf("ERROR: Infinite loop in class %d list.\n", cls);
+                return 0;
+            }
 
-        // 2. Check Allocation Status
-        if (GET_ALLOC(HDRP(bp)) != 0)
-        {
-            printf("ERROR: Block %p in free list is ALLOCATED.\n", bp);
-            return 0;
-        }
+            // 1. Check Allocation Status
+            if (GET_ALLOC(HDRP(bp)) != 0)
+            {
+                printf("ERROR: Block %p in free list is ALLOCATED.\n", bp);
+                return 0;
+            }
 
-        // 3. Check Back-Pointers (Doubly Linked)
-        if (GET_PRV_PTR(bp) != prev)
-        {
-            printf("ERROR: Broken Back-Link at %p. Expected %p, Got %p\n", bp, prev, GET_PRV_PTR(bp));
-            return 0;
+            // 2. Check Back-Pointers (Doubly Linked)
+            if (GET_PRV_PTR(bp) != prev)
+            {
+                printf("ERROR: Broken Back-Link at %p. Expected %p, Got %p\n", bp, prev, GET_PRV_PTR(bp));
+                return 0;
+            }
+
+            // 3. Check Binning (Block sits in the list for its size)
+            if (get_class(GET_SIZE(HDRP(bp))) != cls)
+            {
+                printf("ERROR: Block %p (size %zu) filed under class %d.\n", bp, (size_t)GET_SIZE(HDRP(bp)), cls);
+                return 0;
+            }
+
+            prev = bp;
+            bp = GET_NXT_PTR(bp);
         }
+    }
+    return 1;
+}
 
-        prev = bp;
-        bp = GET_NXT_PTR(bp);
+// Validates every arena
+int check_list_integrity()
+{
+    for (int i = 0; i < narenas; i++)
+    {
+        if (!check_arena_integrity(arenas[i]))
+            return 0;
     }
     return 1;
 }
 
+// Returns 1 if any size class holds a free block
+int any_free_block()
+{
+    for (int cls = 0; cls < NUM_CLASSES; cls++)
+    {
+        if (main_arena.seg_lists[cls] != NULL)
+            return 1;
+    }
+    return 0;
+}
+
 /* --- SECTION 1: BASIC FUNCTIONALITY --- */
 
 void test_initialization()
 {
     printf("\n=== Test 1: Initialization ===\n");
-    heap_list_p = 0;
-    free_list_p = 0;
     mminit();
-    TEST_ASSERT(heap_list_p != NULL, "Heap initialized");
-    TEST_ASSERT(free_list_p != NULL, "Free list created");
+    TEST_ASSERT(main_arena.top != NULL, "Heap initialized");
+    TEST_ASSERT(heap_for_ptr(main_arena.top->hi - 1) == main_arena.top, "Heap header at the aligned heap base");
+    TEST_ASSERT(any_free_block(), "Free list created");
     TEST_ASSERT(check_list_integrity(), "List integrity check");
 }
 
@@ -100,7 +132,7 @@ void test_basic_malloc()
     TEST_ASSERT((uintptr_t)p1 % 16 == 0, "Pointer is 16-byte aligned");
 
     size_t size = GET_SIZE(HDRP(p1));
-    TEST_ASSERT(size >= 32, "Block size meets minimum (32 bytes)");
+    TEST_ASSERT(size >= MIN_BLOCK, "Block size meets minimum (MIN_BLOCK)");
 
     // Verify Write
     *p1 = 'X';
@@ -126,7 +158,7 @@ void test_lifo_policy()
 
     // Free A -> A is Root
     my_free(a);
-    TEST_ASSERT(free_list_p == a, "Freed A -> A is root");
+    TEST_ASSERT(CLASS_ROOT(a) == a, "Freed A -> A is root");
 
     TEST_ASSERT(check_list_integrity(), "List integrity check");
 }
@@ -149,7 +181,7 @@ void test_complex_coalescing()
     my_free(middle);
 
     // Check Result: Should be one massive block starting at Left
-    TEST_ASSERT(free_list_p == left, "Merged block starts at Left");
+    TEST_ASSERT(CLASS_ROOT(left) == left, "Merged block starts at Left");
 
     // Size check: 3 blocks * (64 payload + 16 overhead = 80) = 240 bytes
     // (Note: actual size might vary slightly due to alignment of the first chunk)
@@ -159,11 +191,46 @@ void test_complex_coalescing()
     TEST_ASSERT(check_list_integrity(), "List integrity check");
 }
 
+void test_segregated_classes()
+{
+    printf("\n=== Test 5: Segregated Size Classes ===\n");
+    mminit();
+
+    TEST_ASSERT(get_class(MIN_BLOCK) == 0, "Minimum block maps to class 0");
+#if NUM_CLASSES > 1
+    TEST_ASSERT(get_class(MIN_BLOCK + DWORD) == 1, "Small classes step by DWORD");
+    TEST_ASSERT(get_class(513) == get_class(1024), "Large classes are power-of-two ranges");
+    TEST_ASSERT(get_class(1024) != get_class(1025), "Power-of-two class boundary");
+#endif
+
+    // Free a small and a large block, separated by allocated guards
+    char *small = my_malloc(32);
+    char *guard1 = my_malloc(32);
+    char *large = my_malloc(2000);
+    char *guard2 = my_malloc(32);
+    TEST_ASSERT(guard1 != NULL && guard2 != NULL, "Guards allocated");
+    my_free(small);
+    my_free(large);
+
+#if NUM_CLASSES > 1
+    TEST_ASSERT(CLASS_ROOT(small) == small, "Small block filed in its own class");
+    TEST_ASSERT(CLASS_ROOT(large) == large, "Large block filed in its own class");
+    TEST_ASSERT(CLASS_ROOT(small) != CLASS_ROOT(large), "Classes are independent lists");
+
+    // A small request is served from the small class, leaving the large block alone
+    char *again = my_malloc(32);
+    TEST_ASSERT(again == small, "Exact class hit reuses small block");
+    TEST_ASSERT(GET_ALLOC(HDRP(large)) == 0, "Large block untouched");
+#endif
+
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
 /* --- SECTION 3: SMART REALLOC (OPTIMIZED) --- */
 
 void test_realloc_shrink_split()
 {
-    printf("\n=== Test 5: Realloc Shrink (Splitting) ===\n");
+    printf("\n=== Test 6: Realloc Shrink (Splitting) ===\n");
     mminit();
 
     // Alloc large block
@@ -179,14 +246,14 @@ void test_realloc_shrink_split()
     // Check Remainder
     char *remainder = NXT_BLOCK(new_p);
     TEST_ASSERT(GET_ALLOC(HDRP(remainder)) == 0, "Remainder is free");
-    TEST_ASSERT(free_list_p == remainder, "Remainder added to free list");
+    TEST_ASSERT(CLASS_ROOT(remainder) == remainder, "Remainder added to free list");
 
     TEST_ASSERT(check_list_integrity(), "List integrity check");
 }
 
 void test_realloc_expand_merge()
 {
-    printf("\n=== Test 6: Realloc Expand (Merge & Split) ===\n");
+    printf("\n=== Test 7: Realloc Expand (Merge & Split) ===\n");
     mminit();
 
     // Setup: [ A (64) ] [ B (256, Free) ]
@@ -205,14 +272,14 @@ void test_realloc_expand_merge()
     // Check Remainder of B
     char *remainder = NXT_BLOCK(new_a);
     TEST_ASSERT(GET_ALLOC(HDRP(remainder)) == 0, "Remainder of B is free");
-    TEST_ASSERT(free_list_p == remainder, "Remainder at list root");
+    TEST_ASSERT(CLASS_ROOT(remainder) == remainder, "Remainder at list root");
 
     TEST_ASSERT(check_list_integrity(), "List integrity check");
 }
 
 void test_realloc_fallback()
 {
-    printf("\n=== Test 7: Realloc Fallback (Copy) ===\n");
+    printf("\n=== Test 8: Realloc Fallback (Copy) ===\n");
     mminit();
 
     // Setup: [ A ] [ B (Allocated) ] -> Cannot expand A
@@ -227,22 +294,1409 @@ void test_realloc_fallback()
     TEST_ASSERT(strcmp(new_a, "Testing123") == 0, "Data preserved");
     TEST_ASSERT(GET_ALLOC(HDRP(a)) == 0, "Old block freed");
 
+    // A size that wraps in adjust_size must fail, not look like a shrink
+    errno = 0;
+    TEST_ASSERT(my_realloc(new_a, SIZE_MAX - 8) == NULL && errno == ENOMEM, "Huge realloc fails with ENOMEM");
+    TEST_ASSERT(GET_ALLOC(HDRP(new_a)) && strcmp(new_a, "Testing123") == 0, "Block kept on failure");
+    char *mapped = my_malloc(1 << 20);
+    TEST_ASSERT(my_realloc(mapped, SIZE_MAX - 8) == NULL && GET_MMAPPED(HDRP(mapped)), "Huge realloc of a mapped block fails");
+    my_free(mapped);
+    my_free(new_a);
+    my_free(b);
+
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 4: THREAD CACHE --- */
+
+void test_tcache_hit()
+{
+    printf("\n=== Test 9: Thread Cache Hit ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+
+    char *a = my_malloc(64);
+    char *guard = my_malloc(64);
+    int bin = TCACHE_BIN(GET_SIZE(HDRP(a)));
+    TEST_ASSERT(guard == NXT_BLOCK(a), "Guard keeps the block off the top of the heap");
+
+    my_free(a);
+    TEST_ASSERT(GET_ALLOC(HDRP(a)) == 1, "Cached block stays marked allocated");
+    TEST_ASSERT(tcache.counts[bin] == 1 && tcache.entries[bin] == a, "Block parked in its tcache bin");
+
+    char *b = my_malloc(64);
+    TEST_ASSERT(b == a, "Same-size malloc served from the cache");
+    TEST_ASSERT(tcache.counts[bin] == 0, "Bin emptied");
+
+    my_mallopt(M_TCACHE_COUNT, 0);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+void test_tcache_overflow_flush()
+{
+    printf("\n=== Test 10: Thread Cache Bounded Depth ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+
+    char *blocks[TCACHE_COUNT + 1];
+    for (int i = 0; i <= TCACHE_COUNT; i++)
+        blocks[i] = my_malloc(100);
+    int bin = TCACHE_BIN(GET_SIZE(HDRP(blocks[0])));
+
+    for (int i = 0; i < TCACHE_COUNT; i++)
+        my_free(blocks[i]);
+    TEST_ASSERT(tcache.counts[bin] == TCACHE_COUNT, "Bin fills up to its depth");
+
+    // One more free overflows the bin and flushes a batch to the heap
+    my_free(blocks[TCACHE_COUNT]);
+    TEST_ASSERT(tcache.counts[bin] == TCACHE_COUNT / 2 + 1, "Overflow flushed the bin down to half");
+    TEST_ASSERT(GET_ALLOC(HDRP(blocks[0])) == 0, "Oldest cached blocks returned to the heap");
+
+    my_mallopt(M_TCACHE_COUNT, 0);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+void *tcache_exit_worker(void *arg)
+{
+    char **out = arg;
+    for (int i = 0; i < 4; i++)
+        out[i] = my_malloc(48);
+    for (int i = 0; i < 4; i++)
+        my_free(out[i]);
+    return NULL;
+}
+
+void test_tcache_thread_exit()
+{
+    printf("\n=== Test 11: Thread Cache Flushed On Exit ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+
+    char *blocks[4];
+    pthread_t t;
+    pthread_create(&t, NULL, tcache_exit_worker, blocks);
+    pthread_join(t, NULL);
+
+    int all_free = 1;
+    for (int i = 0; i < 4; i++)
+        all_free &= (GET_ALLOC(HDRP(blocks[i])) == 0);
+    TEST_ASSERT(all_free, "Exiting thread returned its cached blocks");
+
+    my_mallopt(M_TCACHE_COUNT, 0);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+#define STRESS_THREADS 8
+#define STRESS_OPS 20000
+#define STRESS_SLOTS 64
+
+void *tcache_stress_worker(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    char *slots[STRESS_SLOTS] = {0};
+    size_t sizes[STRESS_SLOTS] = {0};
+    long corrupt = 0;
+
+    for (int i = 0; i < STRESS_OPS; i++)
+    {
+        int k = rand_r(&seed) % STRESS_SLOTS;
+        if (slots[k])
+        {
+            // Payload must still hold this thread's pattern
+            if (slots[k][0] != (char)k || slots[k][sizes[k] - 1] != (char)k)
+                corrupt++;
+            my_free(slots[k]);
+            slots[k] = NULL;
+        }
+        else
+        {
+            sizes[k] = (rand_r(&seed) % 1500) + 1;
+            slots[k] = my_malloc(sizes[k]);
+            memset(slots[k], k, sizes[k]);
+        }
+    }
+    for (int k = 0; k < STRESS_SLOTS; k++)
+        my_free(slots[k]);
+    return (void *)corrupt;
+}
+
+void test_tcache_threads()
+{
+    printf("\n=== Test 12: Concurrent Malloc/Free ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+
+    pthread_t threads[STRESS_THREADS];
+    long corrupt = 0;
+    for (long i = 0; i < STRESS_THREADS; i++)
+        pthread_create(&threads[i], NULL, tcache_stress_worker, (void *)(i + 1));
+    for (int i = 0; i < STRESS_THREADS; i++)
+    {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        corrupt += (long)ret;
+    }
+
+    TEST_ASSERT(corrupt == 0, "No payload corruption across threads");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+    my_mallopt(M_TCACHE_COUNT, 0);
+}
+
+/* --- SECTION 5: ARENAS --- */
+
+void *arena_owner_worker(void *arg)
+{
+    void **out = arg;
+    out[0] = my_malloc(200);
+    out[1] = thread_arena;
+    return NULL;
+}
+
+void test_arena_routing()
+{
+    printf("\n=== Test 13: Cross-Thread Free Routes To Owning Arena ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+    my_mallopt(M_ARENA_MAX, ARENA_MAX);
+    my_mallopt(M_REMOTE_FREE, 0); // the locked path; Test 30 covers remote frees
+
+    void *out[2];
+    pthread_t t;
+    pthread_create(&t, NULL, arena_owner_worker, out);
+    pthread_join(t, NULL);
+
+    char *p = out[0];
+    arena_t *owner = out[1];
+    TEST_ASSERT(owner != &main_arena, "New thread was given its own arena");
+    TEST_ASSERT(arena_for_ptr(p) == owner, "Block address maps back to its arena");
+    TEST_ASSERT((char *)owner == (char *)heap_for_ptr(p) + HEAP_HDR_SIZE, "Arena header follows its first heap's header");
+
+    // Freed by the main thread, but must land in the worker's arena lists
+    my_free(p);
+    TEST_ASSERT(GET_ALLOC(HDRP(p)) == 0, "Block freed");
+    TEST_ASSERT(owner->seg_lists[get_class(GET_SIZE(HDRP(p)))] != NULL, "Owner arena holds the free block");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+    my_mallopt(M_REMOTE_FREE, 1);
+}
+
+void *arena_busy_worker(void *arg)
+{
+    (void)arg;
+    thread_arena = &main_arena;
+    return my_malloc(64);
+}
+
+void test_arena_contention()
+{
+    printf("\n=== Test 14: Busy Arena Is Skipped ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+    my_mallopt(M_ARENA_MAX, ARENA_MAX);
+
+    // Hold the main arena lock: a thread assigned to it must move elsewhere
+    pthread_mutex_lock(&main_arena.lock);
+    void *p;
+    pthread_t t;
+    pthread_create(&t, NULL, arena_busy_worker, NULL);
+    pthread_join(t, &p);
+    pthread_mutex_unlock(&main_arena.lock);
+
+    TEST_ASSERT(p != NULL, "Allocation succeeded while main arena was locked");
+    TEST_ASSERT(arena_for_ptr(p) != &main_arena, "Served by another arena");
+    my_free(p);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+void test_arena_threads()
+{
+    printf("\n=== Test 15: 32 Threads Across Arenas ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+    my_mallopt(M_ARENA_MAX, 8);
+
+    pthread_t threads[32];
+    long corrupt = 0;
+    for (long i = 0; i < 32; i++)
+        pthread_create(&threads[i], NULL, tcache_stress_worker, (void *)(i + 100));
+    for (int i = 0; i < 32; i++)
+    {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        corrupt += (long)ret;
+    }
+
+    TEST_ASSERT(narenas > 1, "Threads spread over several arenas");
+    TEST_ASSERT(corrupt == 0, "No payload corruption across threads");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 6: LARGE BLOCKS --- */
+
+void test_mmap_large()
+{
+    printf("\n=== Test 16: Large Blocks Are Mapped Directly ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    char *heap_end = main_arena.top->hi;
+    char *big = my_malloc(1 << 20);
+
+    TEST_ASSERT(big != NULL, "1 MB malloc returned pointer");
+    TEST_ASSERT((uintptr_t)big % 16 == 0, "Pointer is 16-byte aligned");
+    TEST_ASSERT(GET_MMAPPED(HDRP(big)) && GET_ALLOC(HDRP(big)), "Header tagged MMAPPED");
+    TEST_ASSERT(main_arena.top->hi == heap_end, "Heap did not grow");
+    TEST_ASSERT(mmap_usable_size(big) >= (1 << 20), "Mapping covers the request");
+
+    memset(big, 0xAB, 1 << 20);
+    my_free(big);
+    TEST_ASSERT(check_list_integrity(), "Free unmapped without touching free lists");
+
+    char *small = my_malloc(MMAP_THRESHOLD - 1);
+    TEST_ASSERT(!GET_MMAPPED(HDRP(small)), "Below threshold stays in the heap");
+    my_free(small);
+
+    // A length that wraps when the header and page rounding are added
+    void *out[1];
+    errno = 0;
+    TEST_ASSERT(my_malloc(SIZE_MAX - 8) == NULL && errno == ENOMEM, "Huge malloc fails with ENOMEM");
+    TEST_ASSERT(my_calloc(1, SIZE_MAX - 8) == NULL, "Huge calloc fails");
+    TEST_ASSERT(my_memalign(4096, SIZE_MAX / 2) == NULL, "Huge memalign fails");
+    TEST_ASSERT(my_malloc_batch(1, SIZE_MAX - 8, out) == 0, "Huge batch malloc fails");
+}
+
+void test_mmap_threshold_and_realloc()
+{
+    printf("\n=== Test 17: Mapped Realloc & Threshold ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    char *p = my_malloc(200000);
+    strcpy(p, "LargeData");
+
+    // Growth inside the mapping's page slack keeps the pointer
+    char *same = my_realloc(p, mmap_usable_size(p));
+    TEST_ASSERT(same == p, "Realloc within mapping stays in place");
+
+    char *grown = my_realloc(p, 600000);
+    TEST_ASSERT(GET_MMAPPED(HDRP(grown)), "Grown block is still mapped");
+    TEST_ASSERT(strcmp(grown, "LargeData") == 0, "Data preserved on growth");
+
+    char *shrunk = my_realloc(grown, 100);
+    TEST_ASSERT(!GET_MMAPPED(HDRP(shrunk)), "Shrinking below threshold moves into the heap");
+    TEST_ASSERT(strcmp(shrunk, "LargeData") == 0, "Data preserved on shrink");
+    my_free(shrunk);
+
+    TEST_ASSERT(my_mallopt(M_MMAP_THRESHOLD, 4096) == 1, "Threshold is tunable");
+    char *q = my_malloc(8192);
+    TEST_ASSERT(GET_MMAPPED(HDRP(q)), "Lower threshold maps smaller requests");
+    my_free(q);
+    my_mallopt(M_MMAP_THRESHOLD, MMAP_THRESHOLD);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 7: RETURNING MEMORY --- */
+
+// Resident pages in [p, p + len) according to mincore
+size_t resident_pages(char *p, size_t len)
+{
+    size_t page = page_align(1);
+    char *lo = page_floor(p);
+    size_t n = (p + len - lo + page - 1) / page;
+    unsigned char vec[n];
+    size_t count = 0;
+
+    if (mincore(lo, n * page, vec) != 0)
+        return 0;
+    for (size_t i = 0; i < n; i++)
+        count += vec[i] & 1;
+    return count;
+}
+
+void test_heap_trim()
+{
+    printf("\n=== Test 18: Top Of Heap Is Trimmed ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    char *big = my_malloc(100000);
+    char *big2 = my_malloc(100000);
+    char *grown_hi = main_arena.top->hi;
+
+    my_free(big2);
+    my_free(big);
+    TEST_ASSERT(main_arena.top->hi < grown_hi, "Heap end moved back");
+    TEST_ASSERT(main_arena.top->committed == main_arena.top->hi, "Pages past the end decommitted");
+    TEST_ASSERT(GET_SIZE(HDRP(big)) <= TRIM_KEEP + page_align(1), "Top block cut down to TRIM_KEEP");
+    TEST_ASSERT(GET_SIZE(HDRP(NXT_BLOCK(big))) == 0 && GET_ALLOC(HDRP(NXT_BLOCK(big))), "Epilogue rewritten");
+
+    // The trimmed space is handed out again on demand
+    char *again = my_malloc(100000);
+    TEST_ASSERT(again == big, "Heap regrows over the trimmed range");
+    my_free(again);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+void test_interior_release()
+{
+    printf("\n=== Test 19: Interior Free Pages Released ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+    my_mallopt(M_RELEASE_THRESHOLD, 64 * 1024);
+
+    char *hole = my_malloc(100000);
+    char *pin = my_malloc(64); // keeps the hole off the top of the heap
+    memset(hole, 0x5A, 100000);
+    TEST_ASSERT(resident_pages(hole, 100000) >= 20, "Hole is resident while in use");
+
+    my_free(hole);
+    TEST_ASSERT(GET_ALLOC(HDRP(hole)) == 0, "Hole is free");
+#if RELEASE_ADVICE == MADV_DONTNEED
+    // MADV_FREE pages stay resident until the kernel is short of memory
+    TEST_ASSERT(resident_pages(hole, 100000) <= 2, "Only the tag/link pages stay resident");
+#endif
+    TEST_ASSERT(CLASS_ROOT(hole) == hole, "Free-list links survived madvise");
+    TEST_ASSERT(GET(HDRP(hole)) == GET(FTRP(hole)), "Boundary tags survived madvise");
+
+    char *reuse = my_malloc(90000);
+    TEST_ASSERT(reuse == hole, "Released block is reused");
+    memset(reuse, 1, 90000);
+
+    my_free(reuse);
+    my_free(pin);
+    my_mallopt(M_RELEASE_THRESHOLD, RELEASE_THRESHOLD);
     TEST_ASSERT(check_list_integrity(), "List integrity check");
 }
 
+/* --- SECTION 8: HEAP BACKEND --- */
+
+void test_heap_reservation()
+{
+    printf("\n=== Test 20: Heaps Commit On Demand And Chain ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+    my_mallopt(M_MMAP_THRESHOLD, 1 << 30);
+
+    heap_t *first = main_arena.top;
+    TEST_ASSERT(first->committed - (char *)first <= 2 * CHUNKSIZE, "Only the first chunk is committed");
+    TEST_ASSERT(first->ar == &main_arena && first->prev == NULL, "Heap owned by the main arena");
+
+    // 8 MB blocks: the 64 MB reservation runs out and a second heap takes over
+    char *blocks[10];
+    for (int i = 0; i < 10; i++)
+    {
+        blocks[i] = my_malloc(8 << 20);
+        blocks[i][0] = (char)i;
+        blocks[i][(8 << 20) - 1] = (char)i;
+    }
+
+    TEST_ASSERT(main_arena.top != first && main_arena.top->prev == first, "Arena moved on to a second heap");
+    TEST_ASSERT(heap_for_ptr(blocks[0]) == first && heap_for_ptr(blocks[9]) == main_arena.top, "Blocks map to their own heap");
+    TEST_ASSERT(arena_for_ptr(blocks[9]) == &main_arena, "Second heap routes frees to the main arena");
+    TEST_ASSERT((uintptr_t)main_arena.top % HEAP_SIZE == 0, "Second heap is aligned");
+
+    int intact = 1;
+    for (int i = 0; i < 10; i++)
+        intact &= blocks[i][0] == (char)i && blocks[i][(8 << 20) - 1] == (char)i;
+    TEST_ASSERT(intact, "Blocks in both heaps hold their data");
+
+    for (int i = 0; i < 10; i++)
+        my_free(blocks[i]);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+    my_mallopt(M_MMAP_THRESHOLD, MMAP_THRESHOLD);
+}
+
+/* --- SECTION 9: REALLOC WITHOUT COPYING --- */
+
+void test_realloc_backward()
+{
+    printf("\n=== Test 21: Realloc Expands Into Free Predecessor ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    // Setup: [ P (256, Free) ] [ A ] [ Guard ]
+    char *p = my_malloc(256);
+    char *a = my_malloc(64);
+    char *guard = my_malloc(32);
+    my_free(p);
+    strcpy(a, "SlideDown");
+
+    char *new_a = my_realloc(a, 200);
+    TEST_ASSERT(new_a == p, "Block moved down into predecessor");
+    TEST_ASSERT(strcmp(new_a, "SlideDown") == 0, "Data preserved by memmove");
+    TEST_ASSERT(GET_ALLOC(HDRP(new_a)) && GET_SIZE(HDRP(new_a)) >= 200 + WORD, "Merged block allocated and large enough");
+    TEST_ASSERT(GET_PREV_ALLOC(HDRP(new_a)) && GET_PREV_ALLOC(HDRP(NXT_BLOCK(new_a))), "PREV_ALLOC flags agree");
+
+    char *remainder = NXT_BLOCK(new_a);
+    TEST_ASSERT(GET_ALLOC(HDRP(remainder)) == 0 && NXT_BLOCK(remainder) == guard, "Remainder freed up to the guard");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+    my_free(new_a);
+    my_free(guard);
+
+    // Setup: [ P (64, Free) ] [ B (64) ] [ N (64, Free) ] [ Guard ] -> needs all three
+    mminit();
+    p = my_malloc(64);
+    char *b = my_malloc(64);
+    char *n = my_malloc(64);
+    guard = my_malloc(32);
+    my_free(p);
+    my_free(n);
+    memset(b, 'Z', 64);
+
+    char *new_b = my_realloc(b, 216);
+    TEST_ASSERT(new_b == p, "Predecessor + block + successor merged");
+    TEST_ASSERT(new_b[0] == 'Z' && new_b[63] == 'Z', "Payload moved intact");
+#ifdef COMPACT_TAGS
+    // 16 bytes left over is a whole minimum block with compact tags
+    TEST_ASSERT(NXT_BLOCK(NXT_BLOCK(new_b)) == guard, "Successor absorbed, 16-byte remainder split off");
+#else
+    TEST_ASSERT(NXT_BLOCK(new_b) == guard, "Successor absorbed (remainder too small to split)");
+#endif
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+void test_mremap_realloc()
+{
+    printf("\n=== Test 22: Mapped Realloc Uses mremap ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    size_t mb = 1 << 20;
+    char *p = my_malloc(mb);
+    memset(p, 'L', mb);
+
+    char *grown = my_realloc(p, 100 * mb);
+    TEST_ASSERT(grown != NULL && GET_MMAPPED(HDRP(grown)), "100 MB block is still mapped");
+    TEST_ASSERT(mmap_usable_size(grown) >= 100 * mb, "Mapping resized to cover the request");
+    TEST_ASSERT(grown[0] == 'L' && grown[mb - 1] == 'L', "Pages carried over without a copy");
+    grown[100 * mb - 1] = 'E';
+
+    char *shrunk = my_realloc(grown, 2 * mb);
+    TEST_ASSERT(shrunk == grown, "Shrinking a mapping stays in place");
+    TEST_ASSERT(GET_SIZE(HDRP(shrunk)) == page_align(2 * mb + MMAP_OFFSET(shrunk)), "Tail pages unmapped");
+    TEST_ASSERT(shrunk[mb - 1] == 'L', "Data preserved on shrink");
+    my_free(shrunk);
+}
+
+/* --- SECTION 10: CALLOC --- */
+
+void test_calloc()
+{
+    printf("\n=== Test 23: Calloc Skips Known-Zero Memory ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    // Fresh heap: the first chunk and the growth behind it were never written
+    char *fresh = my_calloc(25000, 4);
+    TEST_ASSERT(fresh != NULL, "Calloc returned pointer");
+    TEST_ASSERT(resident_pages(fresh, 100000) <= 3, "Untouched pages not faulted in");
+    int clean = 1;
+    for (int i = 0; i < 100000; i++)
+        clean &= fresh[i] == 0;
+    TEST_ASSERT(clean, "Fresh block reads as zero");
+
+    char *rest = NXT_BLOCK(fresh);
+    TEST_ASSERT(!GET_ALLOC(HDRP(rest)) && GET_ZEROED(HDRP(rest)), "Split remainder still tagged ZEROED");
+
+    // Recycled memory is cleared for real
+    char *dirty = my_malloc(200);
+    char *guard = my_malloc(32);
+    memset(dirty, 0xFF, 200);
+    my_free(dirty);
+    TEST_ASSERT(!GET_ZEROED(HDRP(dirty)), "Freed block loses ZEROED");
+    char *again = my_calloc(50, 4);
+    TEST_ASSERT(again == dirty, "Recycled block reused");
+    clean = 1;
+    for (int i = 0; i < 200; i++)
+        clean &= again[i] == 0;
+    TEST_ASSERT(clean, "Recycled block cleared");
+
+    TEST_ASSERT(my_calloc(SIZE_MAX / 2, 4) == NULL, "Size overflow rejected");
+
+    char *big = my_calloc(1, 1 << 20);
+    TEST_ASSERT(GET_MMAPPED(HDRP(big)) && big[0] == 0 && big[(1 << 20) - 1] == 0, "Large calloc mapped and zero");
+
+    my_free(big);
+    my_free(again);
+    my_free(guard);
+    my_free(fresh);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 11: ALIGNED ALLOCATION --- */
+
+void test_memalign()
+{
+    printf("\n=== Test 24: Aligned Allocation ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    char *odd = my_malloc(48); // knock the heap off any lucky alignment
+    char *a64 = my_memalign(64, 100);
+    TEST_ASSERT(a64 != NULL && (uintptr_t)a64 % 64 == 0, "64-byte aligned");
+    TEST_ASSERT(GET_SIZE(HDRP(a64)) == adjust_size(100), "Trailing slop split off");
+    TEST_ASSERT(GET_PREV_ALLOC(HDRP(NXT_BLOCK(a64))), "Slop block knows its predecessor is allocated");
+
+    char *page = my_aligned_alloc(4096, 4096);
+    TEST_ASSERT(page != NULL && (uintptr_t)page % 4096 == 0, "4 KB aligned");
+    TEST_ASSERT(GET_SIZE(HDRP(page)) == adjust_size(4096), "No over-allocation kept");
+    char *lead = PRV_BLOCK(page);
+    TEST_ASSERT(!GET_ALLOC(HDRP(lead)) && CLASS_ROOT(lead) != NULL, "Leading slop returned to the free lists");
+    memset(a64, 0x11, 100);
+    memset(page, 0x22, 4096);
+    TEST_ASSERT(a64[99] == 0x11 && page[0] == 0x22, "Aligned blocks are writable and disjoint");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+
+    void *pm = NULL;
+    TEST_ASSERT(my_posix_memalign(&pm, 24, 64) == EINVAL, "posix_memalign rejects non-power-of-two");
+    TEST_ASSERT(my_posix_memalign(&pm, 256, 64) == 0 && (uintptr_t)pm % 256 == 0, "posix_memalign 256");
+    errno = 0;
+    TEST_ASSERT(my_aligned_alloc(48, 96) == NULL && errno == EINVAL, "aligned_alloc rejects non-power-of-two with EINVAL");
+    errno = 0;
+    TEST_ASSERT(my_aligned_alloc(0, 96) == NULL && errno == EINVAL, "aligned_alloc rejects a zero alignment with EINVAL");
+    errno = 0;
+    TEST_ASSERT(my_memalign((size_t)1 << 63, 64) == NULL && errno == EINVAL, "Oversized alignment fails with EINVAL");
+    errno = 0;
+    TEST_ASSERT(my_memalign(64, SIZE_MAX - 8) == NULL && errno == ENOMEM, "Oversized aligned request fails with ENOMEM");
+    TEST_ASSERT(my_posix_memalign(&pm, (size_t)1 << 63, 64) == EINVAL, "posix_memalign rejects an oversized alignment");
+
+    char *huge = my_memalign(1 << 16, 1 << 20);
+    TEST_ASSERT(GET_MMAPPED(HDRP(huge)) && (uintptr_t)huge % (1 << 16) == 0, "Large aligned block mapped at 64 KB boundary");
+    TEST_ASSERT(mmap_usable_size(huge) >= (1 << 20), "Aligned mapping covers the request");
+    huge[(1 << 20) - 1] = 1;
+
+    my_free(huge);
+    my_free(pm);
+    my_free(page);
+    my_free(a64);
+    my_free(odd);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 12: SIZED FREE --- */
+
+// Runs fn in a child process; returns 1 if the child died with SIGABRT
+int aborts(void (*fn)(void))
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDERR_FILENO);
+        fn();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+void free_wrong_size(void)
+{
+    char *p = my_malloc(64);
+    my_free_sized(p, 500);
+}
+
+void free_sized_twice(void)
+{
+    char *p = my_malloc(2000);
+    my_free_sized(p, 2000);
+    my_free_sized(p, 2000);
+}
+
+void test_free_sized()
+{
+    printf("\n=== Test 25: Sized Free & Usable Size ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    char *a = my_malloc(100);
+    TEST_ASSERT(my_malloc_usable_size(a) >= 100, "Usable size covers the request");
+    TEST_ASSERT(my_malloc_usable_size(a) == GET_SIZE(HDRP(a)) - WORD, "Usable size is the whole payload");
+
+    // Fill the slack: the neighbour must be untouched
+    char *b = my_malloc(100);
+    strcpy(b, "Neighbour");
+    memset(a, 0x7E, my_malloc_usable_size(a));
+    TEST_ASSERT(strcmp(b, "Neighbour") == 0, "Writing all usable bytes stays inside the block");
+
+    my_free_sized(a, my_malloc_usable_size(a));
+    TEST_ASSERT(GET_ALLOC(HDRP(a)) == 0, "Sized free with usable size accepted");
+    my_free_sized(b, 100);
+    TEST_ASSERT(GET_ALLOC(HDRP(b)) == 0, "Sized free with requested size accepted");
+
+    char *big = my_malloc(1 << 20);
+    TEST_ASSERT(my_malloc_usable_size(big) >= (1 << 20), "Usable size of a mapped block");
+    my_free_sized(big, 1 << 20);
+    TEST_ASSERT(my_malloc_usable_size(NULL) == 0, "Usable size of NULL is 0");
+
+    TEST_ASSERT(aborts(free_wrong_size), "Mismatched size aborts");
+    TEST_ASSERT(aborts(free_sized_twice), "Double sized free aborts");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 13: BATCH API --- */
+
+void test_batch()
+{
+    printf("\n=== Test 26: Batch Malloc & Free ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    void *nodes[300];
+    size_t got = my_malloc_batch(300, 40, nodes);
+    TEST_ASSERT(got == 300, "All 300 nodes allocated");
+
+    int contiguous = 1, sized = 1;
+    for (int i = 0; i < 300; i++)
+    {
+        sized &= GET_ALLOC(HDRP(nodes[i])) && GET_SIZE(HDRP(nodes[i])) >= adjust_size(40);
+        if (i > 0)
+            contiguous &= nodes[i] == NXT_BLOCK(nodes[i - 1]);
+        memset(nodes[i], i & 0xFF, 40);
+    }
+    TEST_ASSERT(sized, "Every node is allocated and large enough");
+    TEST_ASSERT(contiguous, "Nodes carved back to back from one block");
+    TEST_ASSERT(((char *)nodes[299])[39] == (char)299 && ((char *)nodes[0])[0] == 0, "Nodes hold their own data");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+
+    // Shuffle, mix in NULL and a mapped block, then free them all at once
+    srand(11);
+    for (int i = 299; i > 0; i--)
+    {
+        int j = rand() % (i + 1);
+        void *t = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = t;
+    }
+    char *lowest = NULL;
+    for (int i = 0; i < 300; i++)
+        if (lowest == NULL || (char *)nodes[i] < lowest)
+            lowest = nodes[i];
+    void *extra[302];
+    memcpy(extra, nodes, sizeof(nodes));
+    extra[300] = NULL;
+    extra[301] = my_malloc(1 << 20);
+
+    my_free_batch(302, extra);
+    TEST_ASSERT(GET_ALLOC(HDRP(lowest)) == 0, "Batch freed");
+    TEST_ASSERT(GET_SIZE(HDRP(NXT_BLOCK(lowest))) == 0, "Whole run coalesced into the top block");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 14: FAST BINS --- */
+
+void test_fastbins()
+{
+    printf("\n=== Test 27: Fast Bins Defer Coalescing ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+    TEST_ASSERT(my_mallopt(M_MXFAST, 128) == 1, "Fast bins enabled");
+
+    char *a = my_malloc(64);
+    char *b = my_malloc(64);
+    char *guard = my_malloc(64);
+    my_free(a);
+    my_free(b);
+
+    TEST_ASSERT(GET_ALLOC(HDRP(a)) && GET_ALLOC(HDRP(b)), "Freed blocks stay tagged allocated");
+    TEST_ASSERT(main_arena.fastbins[FASTBIN_INDEX(GET_SIZE(HDRP(a)))] == b, "Last freed block heads its fast bin");
+    TEST_ASSERT(GET_SIZE(HDRP(a)) == adjust_size(64), "Neighbours not merged");
+
+    char *again = my_malloc(64);
+    TEST_ASSERT(again == b, "Same-size malloc served from the fast bin");
+
+    // A large request flushes the bins: a and b merge with each other
+    my_free(again);
+    char *big = my_malloc(2000);
+    TEST_ASSERT(!main_arena.have_fast, "Large request consolidated the fast bins");
+    TEST_ASSERT(!GET_ALLOC(HDRP(a)) && GET_SIZE(HDRP(a)) == 2 * adjust_size(64), "Deferred blocks coalesced");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+
+    // Turning the mode off flushes whatever is still binned
+    my_free(guard);
+    TEST_ASSERT(main_arena.have_fast, "Guard parked in a fast bin");
+    TEST_ASSERT(my_mallopt(M_MXFAST, 0) == 1, "Fast bins disabled");
+    TEST_ASSERT(!main_arena.have_fast && !GET_ALLOC(HDRP(guard)), "Disabling consolidates");
+    TEST_ASSERT(my_mallopt(M_MXFAST, MXFAST_MAX + 1) == 0, "Oversized limit rejected");
+    my_free(big);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 15: HEAP PROFILER --- */
+
+extern char __start_profiled_site_text[], __stop_profiled_site_text[];
+
+// Named allocation site the samples should be attributed to (touching the block keeps the call out of tail position).
+// Its own section bounds its code even when my_malloc is inlined into it.
+__attribute__((noinline, section("profiled_site_text"))) void *profiled_site(size_t size)
+{
+    char *p = my_malloc(size);
+    p[0] = 1;
+    return p;
+}
+
+// Occupied slots in the sample table; live ones only if 'live_only'
+size_t prof_count(int live_only)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < PROF_TABLE_SIZE; i++)
+        if (prof_table[i].ptr != NULL && (prof_table[i].live || !live_only))
+            n++;
+    return n;
+}
+
+void test_heap_profiler()
+{
+    printf("\n=== Test 28: Sampling Heap Profiler ===\n");
+    mminit();
+    void *blocks[100];
+    char buf[4096];
+
+    TEST_ASSERT(my_heap_profile_dump(-1) == -1, "Dump refused before profiling is enabled");
+    TEST_ASSERT(my_mallopt(M_PROFILE_INTERVAL, 1) == 1, "Profiling enabled at every byte");
+
+    my_free(my_malloc(64)); // the first allocation of a thread only seeds its countdown
+    int sampled = 0, attributed = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        blocks[i] = profiled_site(64 + i);
+        if (GET(HDRP(blocks[i])) & SAMPLED)
+            sampled++;
+    }
+    TEST_ASSERT(sampled >= 90, "Nearly every allocation sampled and tagged");
+    TEST_ASSERT(prof_count(1) >= (size_t)sampled, "Samples live in the table");
+
+    for (size_t i = 0; i < PROF_TABLE_SIZE; i++)
+    {
+        prof_sample_t *smp = &prof_table[i];
+        if (smp->ptr == blocks[0] && smp->live && smp->depth > 0 &&
+            (char *)smp->frames[0] > __start_profiled_site_text && (char *)smp->frames[0] < __stop_profiled_site_text)
+            attributed = 1;
+    }
+    TEST_ASSERT(attributed, "Innermost frame is the calling site, allocator frames skipped");
+
+    size_t live_before = prof_count(1);
+    for (int i = 0; i < 100; i += 2)
+        my_free(blocks[i]);
+    TEST_ASSERT(prof_count(1) <= live_before - 45 && prof_count(0) >= live_before, "Freed samples kept but no longer live");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+
+    // Dump to a file and check the pprof framing
+    FILE *f = tmpfile();
+    TEST_ASSERT(my_heap_profile_dump(fileno(f)) == 0, "Profile dumped");
+    rewind(f);
+    size_t got = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[got] = '\0';
+    TEST_ASSERT(strncmp(buf, "heap profile: ", 14) == 0 && strstr(buf, "@ heap_v2/1\n") != NULL, "Header line in heap_v2 format");
+    TEST_ASSERT(strstr(buf, "\n1: ") != NULL && strstr(buf, "\n0: 0 [1: ") != NULL, "Live and freed sample lines");
+    fseek(f, 0, SEEK_SET);
+    int mapped = 0;
+    while (fgets(buf, sizeof(buf), f))
+        if (strcmp(buf, "MAPPED_LIBRARIES:\n") == 0)
+            mapped = 1;
+    fclose(f);
+    TEST_ASSERT(mapped, "Memory map appended for symbolization");
+
+    // A failed realloc keeps the caller's block, so its sample stays live; a resize carries it over
+    size_t live_held = prof_count(1);
+    TEST_ASSERT(my_realloc(blocks[1], (size_t)1 << 62) == NULL, "Impossible realloc fails");
+    TEST_ASSERT((GET(HDRP(blocks[1])) & SAMPLED) && prof_count(1) == live_held, "Failed realloc keeps the sample live");
+    blocks[1] = my_realloc(blocks[1], 16);
+    int resized = 0;
+    for (size_t i = 0; i < PROF_TABLE_SIZE; i++)
+        if (prof_table[i].ptr == blocks[1] && prof_table[i].live && prof_table[i].size == 16)
+            resized = 1;
+    TEST_ASSERT(resized && (GET(HDRP(blocks[1])) & SAMPLED) && prof_count(1) == live_held, "Resized block keeps one live sample at its new size");
+
+    for (int i = 1; i < 100; i += 2)
+        my_free(blocks[i]);
+
+    // Batch allocations are sampled block by block, heap-carved and mapped alike
+    void *batch[8];
+    got = my_malloc_batch(8, 64, batch);
+    sampled = 0;
+    for (size_t i = 0; i < got; i++)
+        sampled += (GET(HDRP(batch[i])) & SAMPLED) != 0;
+    TEST_ASSERT(got == 8 && sampled == 8, "Every carved batch block sampled");
+    my_free_batch(got, batch);
+    got = my_malloc_batch(2, mmap_threshold, batch);
+    TEST_ASSERT(got == 2 && (GET(HDRP(batch[0])) & SAMPLED) && (GET(HDRP(batch[1])) & SAMPLED), "Mapped batch blocks sampled");
+    my_free_batch(got, batch);
+
+    // Sampling rate: 16 MB of small allocations at a 1 MB interval
+    TEST_ASSERT(my_mallopt(M_PROFILE_INTERVAL, 1 << 20) == 1, "Interval set to 1 MB");
+    size_t before = prof_count(0);
+    for (int i = 0; i < (16 << 20) / 64; i++)
+        my_free(profiled_site(64));
+    size_t taken = prof_count(0) - before;
+    printf("  %zu samples over 16 MB\n", taken);
+    TEST_ASSERT(taken >= 4 && taken <= 40, "About one sample per interval");
+
+    TEST_ASSERT(my_mallopt(M_PROFILE_INTERVAL, 0) == 1, "Profiling disabled");
+    void *p = my_malloc(64);
+    TEST_ASSERT(!(GET(HDRP(p)) & SAMPLED), "No samples once disabled");
+    my_free(p);
+    TEST_ASSERT(my_mallopt(M_PROFILE_INTERVAL, -1) == 0, "Negative interval rejected");
+
+    // The fork handlers must hold the profiler lock too, or a child can inherit it locked
+    my_malloc_lock_all();
+    int held = pthread_mutex_trylock(&prof_lock) == EBUSY && pthread_mutex_trylock(&main_arena.lock) == EBUSY;
+    my_malloc_unlock_all();
+    TEST_ASSERT(held, "Lock-all holds the arena and profiler locks");
+    TEST_ASSERT(pthread_mutex_trylock(&prof_lock) == 0, "Unlock-all releases them");
+    pthread_mutex_unlock(&prof_lock);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 16: HUGE PAGES --- */
+
+// AnonHugePages (KB) of the mappings overlapping [lo, hi), from /proc/self/smaps
+size_t anon_huge_kb(char *lo, char *hi)
+{
+    char line[256];
+    size_t total = 0, kb;
+    int inside = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        uintptr_t start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+            inside = start < (uintptr_t)hi && end > (uintptr_t)lo;
+        else if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+            total += kb;
+    }
+    fclose(f);
+    return total;
+}
+
+// THP available to madvise callers
+int thp_enabled()
+{
+    char buf[64] = {0};
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (f == NULL)
+        return 0;
+    if (fgets(buf, sizeof(buf), f) == NULL)
+        buf[0] = '\0';
+    fclose(f);
+    return strstr(buf, "[never]") == NULL && buf[0] != '\0';
+}
+
+void test_hugepages()
+{
+    printf("\n=== Test 29: Huge Page Heap Growth ===\n");
+    TEST_ASSERT(my_mallopt(M_HUGEPAGES, 2) == 0, "Bad value rejected");
+    TEST_ASSERT(my_mallopt(M_HUGEPAGES, 1) == 1, "Huge pages enabled");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    heap_t *h = main_arena.top;
+    TEST_ASSERT(((uintptr_t)h->committed & (HUGE_PAGE_SIZE - 1)) == 0, "Fresh heap committed to a 2 MB boundary");
+
+    // 8 MB of touched blocks grow the heap in 2 MB steps
+    char *blocks[64];
+    for (int i = 0; i < 64; i++)
+    {
+        blocks[i] = my_malloc(120 * 1024);
+        memset(blocks[i], 1, 120 * 1024);
+    }
+    TEST_ASSERT(((uintptr_t)h->committed & (HUGE_PAGE_SIZE - 1)) == 0, "Growth stays 2 MB aligned");
+    TEST_ASSERT(h->committed - h->hi < (long)HUGE_PAGE_SIZE, "At most one granule committed ahead");
+    if (thp_enabled())
+    {
+        size_t huge = anon_huge_kb((char *)h, h->committed);
+        printf("  AnonHugePages in heap: %zu KB\n", huge);
+        TEST_ASSERT(huge >= 2048, "Heap backed by transparent huge pages");
+    }
+    else
+    {
+        printf("  THP disabled on this kernel: advice ignored, heap still grows\n");
+    }
+
+    // Freeing everything trims back to a 2 MB boundary, not a page one
+    for (int i = 63; i >= 0; i--)
+        my_free(blocks[i]);
+    TEST_ASSERT(h->committed == h->hi && ((uintptr_t)h->hi & (HUGE_PAGE_SIZE - 1)) == 0, "Trim keeps whole huge pages");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+
+    TEST_ASSERT(my_mallopt(M_HUGEPAGES, 0) == 1, "Huge pages disabled");
+    mminit();
+    TEST_ASSERT(main_arena.top->committed - (char *)main_arena.top < (long)HUGE_PAGE_SIZE, "Page-granular growth again");
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+}
+
+/* --- SECTION 17: REMOTE FREES --- */
+
+// Owner thread: allocates 'n' blocks in its own arena, then mallocs once more after they are freed
+typedef struct remote_job_t
+{
+    int n;
+    void **blocks;
+    arena_t *arena;
+    volatile int phase; // 1: blocks ready, 2: freed by the consumer, 3: drained
+} remote_job_t;
+
+void *remote_owner_worker(void *arg)
+{
+    remote_job_t *job = arg;
+    for (int i = 0; i < job->n; i++)
+        job->blocks[i] = my_malloc(100);
+    job->arena = thread_arena;
+    job->phase = 1;
+    while (job->phase != 2)
+        sched_yield();
+    my_free(my_malloc(100)); // next malloc drains the stack
+    job->phase = 3;
+    return NULL;
+}
+
+// Frees every block handed over by a producer; returns the number freed
+void *remote_consumer_worker(void *arg)
+{
+    void **ring = arg;
+    long n = 0;
+    for (;;)
+    {
+        void *p;
+        while ((p = __atomic_exchange_n(&ring[n % 64], NULL, __ATOMIC_ACQUIRE)) == NULL)
+            sched_yield();
+        if (p == (void *)1)
+            return (void *)n;
+        memset(p, 0xEE, 16);
+        my_free(p);
+        n++;
+    }
+}
+
+void test_remote_free()
+{
+    printf("\n=== Test 30: Lock-Free Remote Frees ===\n");
+    mminit();
+    my_mallopt(M_PROFILE_INTERVAL, 0); // a sampled block's free takes the owner's lock to clear its tag
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+    my_mallopt(M_ARENA_MAX, ARENA_MAX);
+    TEST_ASSERT(my_mallopt(M_REMOTE_FREE, 2) == 0, "Bad value rejected");
+
+    void *blocks[REMOTE_DRAIN_BATCH / 2];
+    remote_job_t job = {REMOTE_DRAIN_BATCH / 2, blocks, NULL, 0};
+    pthread_t t;
+    pthread_create(&t, NULL, remote_owner_worker, &job);
+    while (job.phase != 1)
+        sched_yield();
+    TEST_ASSERT(job.arena != &main_arena && arena_for_ptr(blocks[0]) == job.arena, "Owner has its own arena");
+
+    // The owner's lock is held: remote frees must still complete
+    pthread_mutex_lock(&job.arena->lock);
+    for (int i = 0; i < job.n; i++)
+        my_free(blocks[i]);
+    pthread_mutex_unlock(&job.arena->lock);
+    TEST_ASSERT(atomic_load(&job.arena->nremote) == (size_t)job.n, "Frees queued without the owner's lock");
+    TEST_ASSERT(GET_ALLOC(HDRP(blocks[0])) && tcache.counts[TCACHE_BIN(GET_SIZE(HDRP(blocks[0])))] == 0,
+                "Queued blocks stay allocated and skip the freeing thread's cache");
+
+    job.phase = 2;
+    pthread_join(t, NULL);
+    TEST_ASSERT(atomic_load(&job.arena->remote) == NULL && atomic_load(&job.arena->nremote) == 0, "Owner's malloc drained the stack");
+    TEST_ASSERT(!GET_ALLOC(HDRP(blocks[1])), "Drained blocks back in the owner's free lists");
+
+    // A long backlog is drained by the pusher once the lock is free
+    void *more[REMOTE_DRAIN_BATCH];
+    job = (remote_job_t){REMOTE_DRAIN_BATCH, more, NULL, 0};
+    pthread_create(&t, NULL, remote_owner_worker, &job);
+    while (job.phase != 1)
+        sched_yield();
+    for (int i = 0; i < job.n; i++)
+        my_free(more[i]);
+    TEST_ASSERT(atomic_load(&job.arena->nremote) == 0, "Pusher drained a full batch itself");
+    job.phase = 2;
+    pthread_join(t, NULL);
+
+    // Producer/consumer: every block crosses threads
+    void *ring[64] = {0};
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, remote_consumer_worker, ring);
+    for (long i = 0; i < 100000; i++)
+    {
+        void *p = my_malloc(16 + i % 200);
+        memset(p, 0x11, 16);
+        while (__atomic_load_n(&ring[i % 64], __ATOMIC_ACQUIRE) != NULL)
+            sched_yield();
+        __atomic_store_n(&ring[i % 64], p, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&ring[100000 % 64], __ATOMIC_ACQUIRE) != NULL)
+        sched_yield();
+    __atomic_store_n(&ring[100000 % 64], (void *)1, __ATOMIC_RELEASE);
+    void *freed;
+    pthread_join(consumer, &freed);
+    TEST_ASSERT((long)freed == 100000, "Consumer freed every block");
+    my_free(my_malloc(100)); // drain what the consumer left queued
+    TEST_ASSERT(atomic_load(&main_arena.remote) == NULL, "Main arena drained");
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 18: SMALL-OBJECT PAGES --- */
+
+// Frees 'arg' from a thread that has no arena of its own
+void *page_remote_free_worker(void *arg)
+{
+    my_free(arg);
+    return NULL;
+}
+
+void free_from_other_thread(void *p)
+{
+    pthread_t t;
+    pthread_create(&t, NULL, page_remote_free_worker, p);
+    pthread_join(t, NULL);
+}
+
+void test_small_pages()
+{
+    printf("\n=== Test 31: Small-Object Pages ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0); // frees go straight to the pages
+    TEST_ASSERT(my_mallopt(M_SMALL_PAGES, SPAGE_MAX + 1) == 0, "Oversized limit rejected");
+    TEST_ASSERT(my_mallopt(M_SMALL_PAGES, 256) == 1, "Pages enabled");
+
+    // Bump allocation: same-size objects are back to back
+    char *a = my_malloc(24);
+    char *b = my_malloc(24);
+    char *c = my_malloc(24);
+    size_t asize = GET_SIZE(HDRP(a));
+    TEST_ASSERT(b == a + asize && c == b + asize, "Consecutive objects are contiguous");
+    TEST_ASSERT((GET(HDRP(a)) & PAGED) && page_for_ptr(a) == page_for_ptr(c), "Objects tagged PAGED, one page");
+    spage_t *pg = page_for_ptr(a);
+    TEST_ASSERT(pg->asize == asize && pg->used == 3, "Page serves one size and counts its objects");
+    char *big = my_malloc(1000);
+    TEST_ASSERT(!(GET(HDRP(big)) & PAGED), "Requests above the limit use the free lists");
+
+    // Local free list is LIFO
+    my_free(b);
+    TEST_ASSERT(pg->free == b && pg->used == 2, "Free went to the page's list");
+    TEST_ASSERT(my_malloc(24) == b, "Freed object reused first");
+
+    // Frees from another thread land on thread_free and are collected once the local list is empty
+    free_from_other_thread(c);
+    TEST_ASSERT(atomic_load(&pg->thread_free) == c && pg->used == 3, "Remote free queued on the page");
+    char *d = my_malloc(24);
+    TEST_ASSERT(d == c && atomic_load(&pg->thread_free) == NULL, "Collected on the next malloc");
+
+    // calloc from a page still zeroes
+    memset(d, 0xAB, 24);
+    my_free(d);
+    char *z = my_calloc(3, 8);
+    TEST_ASSERT(z == d && z[0] == 0 && z[23] == 0, "calloc clears a reused object");
+
+    // realloc keeps the slot when it fits and moves otherwise
+    strcpy(z, "page");
+    TEST_ASSERT(my_realloc(z, 8) == z, "Shrinking realloc stays in place");
+    char *moved = my_realloc(z, 600);
+    TEST_ASSERT(moved != z && strcmp(moved, "page") == 0 && !(GET(HDRP(moved)) & PAGED), "Growing realloc moved the data");
+    my_free(moved);
+
+    // Fill the page: it is parked, then a remote free through the arena stack brings it back
+    size_t per_page = (SPAGE_SIZE - SPAGE_HDR_SIZE + WORD) / asize;
+    void **objs = my_malloc(2 * per_page * sizeof(void *));
+    size_t n = 0;
+    while (pg->bump + asize - WORD <= pg->end)
+        objs[n++] = my_malloc(24);
+    TEST_ASSERT(pg->used == per_page, "Page holds the expected object count");
+    char *next = my_malloc(24);
+    spage_t *pg2 = page_for_ptr(next);
+    TEST_ASSERT(pg2 != pg && pg->full && atomic_load(&pg->thread_free) == PAGE_FULL, "Full page parked");
+    TEST_ASSERT(main_arena.spages[SPAGE_CLASS(asize)] == pg2, "Only the new page is listed");
+
+    free_from_other_thread(objs[0]);
+    TEST_ASSERT(atomic_load(&main_arena.nremote) == 1, "Free into a parked page took the arena stack");
+    TEST_ASSERT(my_malloc(24) == objs[0] && !pg->full, "Drain relinked the page and its object was reused");
+
+    // An empty page goes back to the heap unless it is the last of its size
+    my_free(next);
+    TEST_ASSERT(main_arena.spages[SPAGE_CLASS(asize)] == pg && pg->next == NULL, "Empty page released");
+    my_free(a);
+    my_free(b);
+    for (size_t i = 0; i < n; i++)
+        my_free(objs[i]);
+    TEST_ASSERT(pg->used == 0 && main_arena.spages[SPAGE_CLASS(asize)] == pg, "Last page of a size kept");
+
+    // Batch free routes page objects back to their pages
+    void *batch[16];
+    for (int i = 0; i < 16; i++)
+        batch[i] = my_malloc(40);
+    spage_t *bpg = page_for_ptr(batch[0]);
+    my_free_batch(16, batch);
+    TEST_ASSERT(bpg->used == 0, "Batch free emptied the page");
+
+    // A shrunk page object keeps its slot; the sized free must accept the new size
+    my_mallopt(M_SMALL_PAGES, 512);
+    char *wide = my_malloc(400);
+    spage_t *wpg = page_for_ptr(wide);
+    size_t wused = wpg->used;
+    char *narrow = my_realloc(wide, 16);
+    TEST_ASSERT(narrow == wide && (GET(HDRP(narrow)) & PAGED), "Shrink keeps the page slot");
+    my_free_sized(narrow, 16);
+    TEST_ASSERT(wpg->used == wused - 1, "Sized free with the shrunk size accepted");
+
+    my_mallopt(M_SMALL_PAGES, 0);
+    char *off = my_malloc(24);
+    TEST_ASSERT(!(GET(HDRP(off)) & PAGED), "Disabled: small requests use the free lists");
+    my_free(off);
+    my_free(objs);
+    my_free(big);
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 19: FOOTER ELISION --- */
+
+// Walks the main arena's single heap: PREV_ALLOC must match each predecessor and free blocks keep a footer
+int check_prev_alloc_flags()
+{
+    char *bp = (char *)main_arena.top + HEAP_HDR_SIZE + 2 * DWORD; // first block after the prologue
+    int prev_alloc = 1;
+
+    for (; GET_SIZE(HDRP(bp)) > 0; bp = NXT_BLOCK(bp))
+    {
+        if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
+        {
+            printf("ERROR: Stale PREV_ALLOC bit at %p\n", bp);
+            return 0;
+        }
+        prev_alloc = GET_ALLOC(HDRP(bp));
+        if (!prev_alloc && GET(HDRP(bp)) != GET(FTRP(bp)))
+        {
+            printf("ERROR: Header/Footer mismatch at %p\n", bp);
+            return 0;
+        }
+    }
+    return !GET_PREV_ALLOC(HDRP(bp)) == !prev_alloc; // epilogue
+}
+
+void test_footer_elision()
+{
+    printf("\n=== Test 32: Footer Elision ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    // calloc taking a whole fresh block: its old footer word is inside the payload now
+    char *z = my_calloc(1, CHUNKSIZE - WORD);
+    int zero = GET_SIZE(HDRP(z)) == CHUNKSIZE;
+    for (int i = 0; i < CHUNKSIZE - WORD; i++)
+        zero &= z[i] == 0;
+    TEST_ASSERT(zero, "calloc clears the stale footer of a ZEROED block");
+    my_free(z);
+
+    char *a = my_malloc(24);
+    char *b = my_malloc(24);
+    TEST_ASSERT(GET_SIZE(HDRP(a)) == 2 * DWORD && b == a + 2 * DWORD, "24-byte request fits a 32-byte block");
+    memset(a, 0x5A, my_malloc_usable_size(a));
+    TEST_ASSERT(GET_ALLOC(HDRP(b)) && GET_PREV_ALLOC(HDRP(b)) && GET_SIZE(HDRP(b)) == 2 * DWORD,
+                "Payload runs up to the next header");
+    my_free(a);
+    TEST_ASSERT(!GET_PREV_ALLOC(HDRP(b)) && GET(FTRP(a)) == GET(HDRP(a)), "Free block has a footer, neighbour's bit cleared");
+    TEST_ASSERT(my_malloc(24) == a && GET_PREV_ALLOC(HDRP(b)), "Reallocation sets the bit again");
+
+    // Random churn through every path that writes tags
+    void *live[256] = {0};
+    int consistent = 1;
+    srand(22);
+    my_mallopt(M_MXFAST, 64);
+    for (int i = 0; i < 20000 && consistent; i++)
+    {
+        int k = rand() % 256;
+        switch (live[k] ? rand() % 3 : 3 + rand() % 3)
+        {
+        case 0:
+            my_free(live[k]);
+            live[k] = NULL;
+            break;
+        case 1:
+        case 2:
+            live[k] = my_realloc(live[k], 1 + rand() % 600);
+            break;
+        case 3:
+            live[k] = my_malloc(1 + rand() % 600);
+            break;
+        case 4:
+            live[k] = my_memalign(64 << (rand() % 3), 1 + rand() % 300);
+            break;
+        case 5:
+            live[k] = my_calloc(1 + rand() % 8, 1 + rand() % 64);
+            break;
+        }
+        if (i % 1000 == 999)
+        {
+            my_mallopt(M_MXFAST, (i / 1000) % 2 ? 64 : 0); // consolidate now and then
+            consistent = check_prev_alloc_flags();
+        }
+    }
+    TEST_ASSERT(consistent, "PREV_ALLOC bits and footers consistent throughout");
+
+    void *batch[64];
+    size_t got = my_malloc_batch(64, 40, batch);
+    TEST_ASSERT(got == 64 && check_prev_alloc_flags(), "Batch carve sets the bits");
+    my_free_batch(got, batch);
+    my_mallopt(M_MXFAST, 0);
+    for (int k = 0; k < 256; k++)
+        my_free(live[k]);
+    my_free(a);
+    my_free(b);
+    TEST_ASSERT(check_prev_alloc_flags(), "Heap consistent after freeing everything");
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+    TEST_ASSERT(check_list_integrity(), "List integrity check");
+}
+
+/* --- SECTION 20: HEAP GROWTH --- */
+
+// mprotect calls to grow a fresh main heap to 4 MB in 1 KB blocks, process-wide and
+// (in *heap_commits) for the heap itself; frees the blocks again, trimming the heap
+size_t commits_to_grow(void **blocks, size_t min, size_t max, size_t *heap_commits)
+{
+    mminit();
+    my_heap_growth(NULL, min, max);
+    blocks[0] = my_malloc(1000);
+    size_t before = my_heap_commits(NULL), heap_before = my_heap_commits(blocks[0]);
+    for (int i = 1; i < 4096; i++)
+        blocks[i] = my_malloc(1000);
+    size_t commits = my_heap_commits(NULL) - before;
+    *heap_commits = my_heap_commits(blocks[0]) - heap_before;
+    for (int i = 4095; i >= 0; i--)
+        my_free(blocks[i]);
+    return commits;
+}
+
+void test_heap_growth()
+{
+    printf("\n=== Test 33: Heap Growth Policy ===\n");
+    static void *blocks[4096];
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    TEST_ASSERT(!my_mallopt(M_GROW_MIN, 2 * GROW_MAX) && !my_mallopt(M_GROW_MAX, GROW_MIN / 2), "Inverted bounds rejected");
+    TEST_ASSERT(my_heap_growth(NULL, 2 * CHUNKSIZE, CHUNKSIZE) == -1, "min above max rejected");
+    TEST_ASSERT(my_heap_growth(NULL, 2 * CHUNKSIZE, 0) == 0 && main_arena.top->grow_min == 2 * CHUNKSIZE, "0 max keeps its default");
+    TEST_ASSERT(my_heap_growth(NULL, 2 * (size_t)GROW_MAX, 0) == -1, "min above the default max rejected");
+    TEST_ASSERT(my_heap_growth(NULL, 0, GROW_MIN / 2) == -1, "max below the default min rejected");
+    my_heap_growth(NULL, 0, 0);
+    void *mapped = my_malloc(MMAP_THRESHOLD);
+    TEST_ASSERT(my_heap_growth(mapped, 0, 0) == -1 && my_heap_commits(mapped) == 0, "Mapped blocks have no heap");
+    my_free(mapped);
+
+    size_t fixed_heap, geometric_heap;
+    size_t fixed = commits_to_grow(blocks, CHUNKSIZE, CHUNKSIZE, &fixed_heap);
+    size_t geometric = commits_to_grow(blocks, 0, 0, &geometric_heap);
+    TEST_ASSERT(fixed == fixed_heap && geometric == geometric_heap, "Per-heap counts match the process total");
+    // 4 KB doubling to the 1 MB cap, then 1 MB steps: about 12 commits instead of ~1000
+    TEST_ASSERT(fixed > 900 && geometric < 16, "Geometric growth cuts commits");
+
+    // The trim shrank the heap: the next step is small again
+    heap_t *h = main_arena.top;
+    size_t committed = h->committed - (char *)h;
+    TEST_ASSERT(committed <= TRIM_THRESHOLD + page_align(1), "Trim dropped the committed tail");
+    void *p = my_malloc(committed);
+    TEST_ASSERT((size_t)(h->committed - (char *)h) - committed <= 2 * committed, "Step after a trim follows the smaller heap");
+    TEST_ASSERT((size_t)(h->committed - h->hi) <= GROW_MAX, "Commit-ahead stays under the cap");
+    my_free(p);
+
+    // A heap that replaces a full one keeps the policy
+    my_heap_growth(NULL, 2 * CHUNKSIZE, 64 * CHUNKSIZE);
+    int n = 0;
+    while (main_arena.top == h && n < 4096)
+        blocks[n++] = my_malloc(100 * 1024);
+    TEST_ASSERT(main_arena.top != h && main_arena.top->grow_max == 64 * CHUNKSIZE, "New heap inherits the policy");
+    while (n > 0)
+        my_free(blocks[--n]);
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+    mminit();
+}
+
+/* --- SECTION 21: COMPACT TAGS --- */
+
+#ifdef COMPACT_TAGS
+void test_compact_tags()
+{
+    printf("\n=== Test 34: Compact Tags ===\n");
+    mminit();
+    my_mallopt(M_TCACHE_COUNT, 0);
+
+    // 4-byte header: 12 bytes of payload fit the 16-byte minimum block
+    char *a = my_malloc(12);
+    char *b = my_malloc(12);
+    char *c = my_malloc(12);
+    char *d = my_malloc(12);
+    TEST_ASSERT(GET_SIZE(HDRP(a)) == 16 && b == a + 16 && d == a + 48, "12-byte requests take 16-byte blocks");
+    memset(a, 0x5A, my_malloc_usable_size(a));
+    TEST_ASSERT(my_malloc_usable_size(a) == 12 && GET_SIZE(HDRP(b)) == 16 && GET_ALLOC(HDRP(b)),
+                "Full payload write leaves the next header intact");
+
+    // Two free 16-byte blocks: links are zone offsets, and the footer still fits behind them
+    my_free(a);
+    my_free(c);
+    char *root = main_arena.seg_lists[0];
+    TEST_ASSERT(root == c && GET_NXT_PTR(c) == a && GET_PRV_PTR(a) == c, "Offset links decode to the blocks");
+    TEST_ASSERT(*(uint32_t *)(c + WORD) == (uint32_t)(a - zone_base) && GET(FTRP(c)) == GET(HDRP(c)),
+                "Link and footer words side by side");
+    TEST_ASSERT(check_list_integrity() && check_prev_alloc_flags(), "Lists and tags consistent");
+
+    // Every heap is a slot of the zone, and a released slot is handed out again
+    heap_t *h = main_arena.top;
+    TEST_ASSERT((char *)h >= zone_base && (char *)h < zone_base + ZONE_SIZE, "Heap lives in the zone");
+    mminit();
+    TEST_ASSERT(main_arena.top == h, "Released heap slot reused");
+
+    // A mapped block's length must fit the 32-bit header
+    TEST_ASSERT(my_malloc(5UL << 30) == NULL, "Mapped block over 4 GB refused");
+    my_mallopt(M_TCACHE_COUNT, TCACHE_COUNT);
+}
+#endif
+
 /* --- MAIN --- */
 int main()
 {
     printf("--- FINAL MASTER TEST SUITE ---\n");
     printf("Testing Optimized Explicit Free List Allocator\n");
 
+    // Sections 1-3 inspect the free lists directly: keep the thread cache out of the way
+    my_mallopt(M_TCACHE_COUNT, 0);
+
     test_initialization();
     test_basic_malloc();
     test_lifo_policy();
     test_complex_coalescing();
+    test_segregated_classes();
     test_realloc_shrink_split();
     test_realloc_expand_merge();
     test_realloc_fallback();
+    test_tcache_hit();
+    test_tcache_overflow_flush();
+    test_tcache_thread_exit();
+    test_tcache_threads();
+    test_arena_routing();
+    test_arena_contention();
+    test_arena_threads();
+    test_mmap_large();
+    test_mmap_threshold_and_realloc();
+    test_heap_trim();
+    test_interior_release();
+    test_heap_reservation();
+    test_realloc_backward();
+    test_mremap_realloc();
+    test_calloc();
+    test_memalign();
+    test_free_sized();
+    test_batch();
+    test_fastbins();
+    test_heap_profiler();
+    test_hugepages();
+    test_remote_free();
+    test_small_pages();
+    test_footer_elision();
+    test_heap_growth();
+#ifdef COMPACT_TAGS
+    test_compact_tags();
+#endif
 
     printf("\n------------------------------------------------\n");
     printf("Summary: %d / %d Tests Passed.\n", tests_passed, tests_total);
@@ -7,6 +7,42 @@
 
 static uint8_t *heap_start;
 
+#ifdef HUGEPAGES
+#include <sys/mman.h>
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define ARENA_MAP_SIZE ((RAM_SIZE + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1))
+
+/*
+ * Map the arena on huge pages (-DHUGEPAGES): hugetlbfs pages if the pool
+ * has any, otherwise a 2 MB-aligned anonymous mapping advised for
+ * transparent huge pages. Returns NULL only if both mappings fail.
+ */
+static uint8_t *arena_map_huge(void)
+{
+    void *p = mmap(NULL, ARENA_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+        return (uint8_t *)p;
+    }
+
+    uint8_t *raw = mmap(NULL, ARENA_MAP_SIZE + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    uint8_t *base = (uint8_t *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    if (base > raw)
+    {
+        munmap(raw, base - raw);
+    }
+    munmap(base + ARENA_MAP_SIZE, raw + HUGE_PAGE_SIZE - base);
+    madvise(base, ARENA_MAP_SIZE, MADV_HUGEPAGE); // ignored without THP
+    return base;
+}
+#endif
+
 typedef struct block_t
 {
     struct block_t *next;
@@ -55,7 +91,14 @@ void list_remove(block_t *block)
 
 void buddy_init()
 {
+#ifdef HUGEPAGES
+    if (heap_start == NULL) // mapped once, reused by later inits
+    {
+        heap_start = arena_map_huge();
+    }
+#else
     heap_start = (uint8_t *)malloc(RAM_SIZE);
+#endif
     if (heap_start == NULL)
     {
         perror("Failed to allocate RAM");
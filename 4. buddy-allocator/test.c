@@ -3,6 +3,27 @@
 #include <assert.h>
 #include <string.h>
 
+#ifdef HUGEPAGES
+#include <errno.h>
+#include <sys/mman.h>
+
+// Refuse MAP_HUGETLB while set, so buddy_init has to take the THP fallback
+static int refuse_hugetlb;
+static int hugetlb_refused;
+
+static void *test_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+    if (refuse_hugetlb && (flags & MAP_HUGETLB))
+    {
+        hugetlb_refused++;
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    return mmap(addr, len, prot, flags, fd, off);
+}
+#define mmap test_mmap
+#endif
+
 #include "alloc.c"
 
 #define ANSI_COLOR_RED "\x1b[31m"
@@ -175,6 +196,39 @@ void test_fragmentation_holes()
     TEST_ASSERT(count_free_blocks(MAX_ORDER) == 1, "Heap eventually fully restored");
 }
 
+#ifdef HUGEPAGES
+void test_huge_arena()
+{
+    printf("\n=== Test 5: Huge Page Arena ===\n");
+    buddy_init();
+    TEST_ASSERT((uintptr_t)heap_start % HUGE_PAGE_SIZE == 0, "Arena is 2 MB-aligned");
+
+    // Drop the arena and map it again with hugetlbfs unavailable
+    munmap(heap_start, ARENA_MAP_SIZE);
+    heap_start = NULL;
+    refuse_hugetlb = 1;
+    buddy_init();
+    refuse_hugetlb = 0;
+    TEST_ASSERT(hugetlb_refused == 1, "MAP_HUGETLB refused, fallback taken");
+    TEST_ASSERT((uintptr_t)heap_start % HUGE_PAGE_SIZE == 0, "Fallback arena is 2 MB-aligned");
+
+    void *small = buddy_alloc(0);
+    void *half = buddy_alloc(MAX_ORDER - 1);
+    TEST_ASSERT(small != NULL && half != NULL, "Fallback arena serves allocations");
+
+    // The block header stays in place: buddy_free reads the order from it
+    uint8_t *small_tail = (uint8_t *)small + PAGE_SIZE - 1;
+    uint8_t *half_tail = (uint8_t *)half + (PAGE_SIZE << (MAX_ORDER - 1)) - 1;
+    *small_tail = 0xAB;
+    *half_tail = 0xCD;
+    TEST_ASSERT(*small_tail == 0xAB && *half_tail == 0xCD, "Blocks are writable and disjoint");
+
+    buddy_free(small);
+    buddy_free(half);
+    TEST_ASSERT(count_free_blocks(MAX_ORDER) == 1, "Fallback arena fully coalesced");
+}
+#endif
+
 int main()
 {
     printf("--- Buddy Allocator Unit Tests ---\n");
@@ -183,6 +237,9 @@ int main()
     test_recursive_split();
     test_buddies_coalesce();
     test_fragmentation_holes();
+#ifdef HUGEPAGES
+    test_huge_arena();
+#endif
 
     printf("\n------------------------------------------------\n");
     printf("Summary: %d / %d Tests Passed.\n", tests_passed, tests_total);
@@ -0,0 +1,471 @@
+/*
+ * TLSF allocator (Two-Level Segregated Fit)
+ *
+ * LEARNING PATH:
+ * - First-fit on a free list (explicit allocator) is O(F): the scan length
+ *   depends on how many free blocks happen to sit ahead of a fit
+ * - Segregating by size class shortens the scan but a class can still hold
+ *   blocks that are too small
+ * - TLSF rounds the request up to the next class boundary, so ANY block in
+ *   that class fits, and two bitmaps find the first non-empty class with
+ *   ffs() in constant time: malloc and free are O(1), worst case
+ *
+ * Block layout and boundary tags are the same as the explicit allocator:
+ *    [ header | payload... | footer ]
+ * Free blocks overlay PREV/NEXT links on the payload.
+ *
+ * Size classes:
+ *   first level  (fl): power-of-two range, fl = fls(size)
+ *   second level (sl): range split linearly into SL_INDEX_COUNT sub-classes
+ *   sizes below SMALL_BLOCK_SIZE all live in fl 0, in DWORD-wide sub-classes
+ *
+ *   fl_bitmap bit f set   <=> some sl list of row f is non-empty
+ *   sl_bitmap[f] bit s set <=> blocks[f][s] is non-empty
+ *
+ * Prologue block: allocated block of size DWORD to make edge conditions simpler.
+ * Epilogue header: zero-size allocated block at the end of the heap.
+ */
+
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+
+#define WORD 8
+#define DWORD 16
+#define CHUNKSIZE (1 << 12)
+
+#define SL_INDEX_COUNT_LOG2 4
+#define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_LOG2) /* 16 sub-classes per power of two */
+#define ALIGN_SIZE_LOG2 4                          /* log2(DWORD) */
+#define FL_INDEX_MAX 32                            /* largest block: 4 GB */
+#define FL_INDEX_SHIFT (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_COUNT (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE (1 << FL_INDEX_SHIFT) /* 256: below this, classes are DWORD apart */
+#define MAX_REQUEST (1UL << (FL_INDEX_MAX - 1))  /* rounded-up search class must stay in range */
+#define MAX_BLOCK ((1UL << FL_INDEX_MAX) - DWORD) /* largest block mapping_insert can file */
+
+#define GET(p) (*(uintptr_t *)(p))
+#define PUT(p, val) (*(uintptr_t *)(p) = (val))
+
+#define PACK(size, alloc) ((size) | (alloc))
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+#define GET_SIZE(p) (GET(p) & ~(DWORD - 1))
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+#define HDRP(bp) ((char *)(bp) - WORD)
+#define FTRP(bp) (((char *)(bp) + GET_SIZE(HDRP(bp))) - DWORD)
+
+#define NXT_BLOCK(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
+#define PRV_BLOCK(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - DWORD))
+
+/* Free list node stores pointers at bp (prev) and bp+WORD (next) */
+#define GET_NXT_PTR(bp) (*(char **)(bp + WORD))
+#define GET_PRV_PTR(bp) (*(char **)(bp))
+
+static char *heap_list_p = 0;
+
+static uint32_t fl_bitmap;
+static uint32_t sl_bitmap[FL_INDEX_COUNT];
+static char *blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+/* Index of least significant set bit (0-based); x must be non-zero */
+static inline int tlsf_ffs(uint32_t x)
+{
+    return __builtin_ffs(x) - 1;
+}
+
+/* Index of most significant set bit (0-based); x must be non-zero */
+static inline int tlsf_fls(size_t x)
+{
+    return 63 - __builtin_clzl(x);
+}
+
+/*
+ * mapping_insert - class a free block of 'size' bytes is filed under
+ * (round down: the block is at least as big as the class minimum)
+ */
+static void mapping_insert(size_t size, int *fli, int *sli)
+{
+    int fl, sl;
+
+    if (size < SMALL_BLOCK_SIZE)
+    {
+        fl = 0;
+        sl = (int)size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+    }
+    else
+    {
+        fl = tlsf_fls(size);
+        sl = (int)(size >> (fl - SL_INDEX_COUNT_LOG2)) ^ (1 << SL_INDEX_COUNT_LOG2);
+        fl -= (FL_INDEX_SHIFT - 1);
+    }
+    *fli = fl;
+    *sli = sl;
+}
+
+/*
+ * mapping_search - class to start searching from for a request of 'size' bytes
+ * (round up to the next class boundary so every block found is a fit)
+ */
+static void mapping_search(size_t size, int *fli, int *sli)
+{
+    if (size >= SMALL_BLOCK_SIZE)
+    {
+        size += (1UL << (tlsf_fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(size, fli, sli);
+}
+
+/* Insert free block at the head of its class list and set the bitmap bits */
+static void insert_node(void *bp)
+{
+    int fl, sl;
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+
+    GET_NXT_PTR(bp) = blocks[fl][sl];
+    GET_PRV_PTR(bp) = NULL;
+    if (blocks[fl][sl] != NULL)
+    {
+        GET_PRV_PTR(blocks[fl][sl]) = bp;
+    }
+    blocks[fl][sl] = bp;
+
+    fl_bitmap |= (1U << fl);
+    sl_bitmap[fl] |= (1U << sl);
+}
+
+/* Remove block from its class list, clearing bitmap bits when the list empties */
+static void delete_node(void *bp)
+{
+    int fl, sl;
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+
+    if (GET_NXT_PTR(bp))
+    {
+        GET_PRV_PTR(GET_NXT_PTR(bp)) = GET_PRV_PTR(bp);
+    }
+    if (GET_PRV_PTR(bp))
+    {
+        GET_NXT_PTR(GET_PRV_PTR(bp)) = GET_NXT_PTR(bp);
+    }
+    else
+    {
+        /* bp was the head of its class list */
+        blocks[fl][sl] = GET_NXT_PTR(bp);
+        if (blocks[fl][sl] == NULL)
+        {
+            sl_bitmap[fl] &= ~(1U << sl);
+            if (sl_bitmap[fl] == 0)
+            {
+                fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+}
+
+/*
+ * coalesce - boundary-tag coalescing. Return pointer to coalesced block.
+ * Neighbours are unlinked before their tags change (their class is derived
+ * from the header), then the merged block is filed under its new class.
+ * A merge that would pass MAX_BLOCK is skipped: the neighbour stays a
+ * separate free block, as if it were allocated.
+ * Four cases:
+ * 1) prev_alloc && next_alloc : no coalescing
+ * 2) prev_alloc && !next_alloc : merge with next
+ * 3) !prev_alloc && next_alloc : merge with previous
+ * 4) !prev_alloc && !next_alloc : merge with both
+ */
+static void *coalesce(void *bp)
+{
+    size_t prev_alloc = GET_ALLOC(FTRP(PRV_BLOCK(bp)));
+    size_t next_alloc = GET_ALLOC(HDRP(NXT_BLOCK(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (!next_alloc && size + GET_SIZE(HDRP(NXT_BLOCK(bp))) > MAX_BLOCK)
+        next_alloc = 1;
+    if (!prev_alloc &&
+        size + (next_alloc ? 0 : GET_SIZE(HDRP(NXT_BLOCK(bp)))) + GET_SIZE(FTRP(PRV_BLOCK(bp))) > MAX_BLOCK)
+        prev_alloc = 1;
+
+    if (prev_alloc && next_alloc)
+    {
+        /* Case 1: nothing to merge */
+    }
+    else if (prev_alloc && !next_alloc)
+    {
+        size += GET_SIZE(HDRP(NXT_BLOCK(bp)));
+        delete_node(NXT_BLOCK(bp));
+        PUT(HDRP(bp), PACK(size, 0));
+        PUT(FTRP(bp), PACK(size, 0));
+    }
+    else if (!prev_alloc && next_alloc)
+    {
+        size += GET_SIZE(FTRP(PRV_BLOCK(bp)));
+        delete_node(PRV_BLOCK(bp));
+        PUT(FTRP(bp), PACK(size, 0));
+        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, 0));
+        bp = PRV_BLOCK(bp);
+    }
+    else
+    {
+        size += GET_SIZE(FTRP(PRV_BLOCK(bp))) + GET_SIZE(HDRP(NXT_BLOCK(bp)));
+        delete_node(PRV_BLOCK(bp));
+        delete_node(NXT_BLOCK(bp));
+        PUT(HDRP(PRV_BLOCK(bp)), PACK(size, 0));
+        PUT(FTRP(NXT_BLOCK(bp)), PACK(size, 0));
+        bp = PRV_BLOCK(bp);
+    }
+    insert_node(bp);
+    return bp;
+}
+
+/*
+ * extend_heap - extend heap by 'words' words, return pointer to new free block's payload
+ * We ensure alignment by making the size an even number of WORDs (so result is multiple of DWORD).
+ */
+static void *extend_heap(size_t words)
+{
+    char *bp;
+    size_t size;
+
+    size = (words % 2) ? (words + 1) * WORD : words * WORD;
+
+    if ((long)(bp = sbrk(size)) == -1)
+        return NULL;
+
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    /* New epilogue: zero-size allocated block marks heap end */
+    PUT(HDRP(NXT_BLOCK(bp)), PACK(0, 1));
+
+    return coalesce(bp);
+}
+
+/*
+ * mminit - create the initial empty heap with prologue and epilogue
+ * Returns 0 on success, -1 on error
+ */
+int mminit(void)
+{
+    if ((heap_list_p = sbrk(4 * WORD)) == (void *)(-1))
+        return -1;
+
+    fl_bitmap = 0;
+    for (int fl = 0; fl < FL_INDEX_COUNT; fl++)
+    {
+        sl_bitmap[fl] = 0;
+        for (int sl = 0; sl < SL_INDEX_COUNT; sl++)
+            blocks[fl][sl] = NULL;
+    }
+
+    /* Prologue: padding (unused), header, footer, and epilogue header */
+    PUT(heap_list_p, 0);
+    PUT(heap_list_p + WORD, PACK(DWORD, 1));
+    PUT(heap_list_p + (2 * WORD), PACK(DWORD, 1));
+    PUT(heap_list_p + (3 * WORD), PACK(0, 1));
+    heap_list_p += (2 * WORD);
+
+    if (extend_heap(CHUNKSIZE / WORD) == NULL)
+        return -1;
+    return 0;
+}
+
+/*
+ * find_fit - good-fit lookup in constant time, no list walk
+ * 1) mask sl_bitmap of the search class to sub-classes >= sl
+ * 2) if empty, mask fl_bitmap to rows > fl and take the lowest row's lowest class
+ * The head of the chosen list is always large enough.
+ */
+static void *find_fit(size_t size)
+{
+    int fl, sl;
+    uint32_t sl_map, fl_map;
+
+    mapping_search(size, &fl, &sl);
+    if (fl >= FL_INDEX_COUNT)
+        return NULL;
+
+    sl_map = sl_bitmap[fl] & (~0U << sl);
+    if (!sl_map)
+    {
+        fl_map = (fl + 1 < FL_INDEX_COUNT) ? (fl_bitmap & (~0U << (fl + 1))) : 0;
+        if (!fl_map)
+            return NULL;
+        fl = tlsf_ffs(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = tlsf_ffs(sl_map);
+    return blocks[fl][sl];
+}
+
+/*
+ * place - place a block of 'size' bytes at start of free block bp
+ * If the remainder would be at least the minimum block size (2*DWORD), split the block.
+ */
+static void place(void *bp, size_t size)
+{
+    size_t asize = GET_SIZE(HDRP(bp));
+
+    delete_node(bp);
+    if ((asize - size) >= (2 * DWORD))
+    {
+        PUT(HDRP(bp), PACK(size, 1));
+        PUT(FTRP(bp), PACK(size, 1));
+
+        PUT(HDRP(NXT_BLOCK(bp)), PACK((asize - size), 0));
+        PUT(FTRP(NXT_BLOCK(bp)), PACK((asize - size), 0));
+        insert_node(NXT_BLOCK(bp));
+    }
+    else
+    {
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+    }
+}
+
+/* Block size (payload + header/footer, DWORD aligned) for a request of 'size' bytes */
+static size_t adjust_size(size_t size)
+{
+    if (size <= DWORD)
+        return 2 * DWORD;
+    return DWORD * ((size + DWORD + (DWORD - 1)) / DWORD);
+}
+
+/*
+ * my_malloc - allocate a block with at least 'size' bytes of payload
+ * Returns pointer to payload, or NULL on failure
+ */
+void *my_malloc(size_t size)
+{
+    char *bp;
+    size_t asize;
+
+    if (heap_list_p == 0)
+    {
+        mminit();
+    }
+
+    if (size == 0 || size > MAX_REQUEST)
+        return NULL;
+
+    asize = adjust_size(size);
+
+    if ((bp = find_fit(asize)) != NULL)
+    {
+        place(bp, asize);
+        return bp;
+    }
+
+    /*
+     * No fit found; extend heap. Ask for enough that the new block
+     * lands in the search class even if it does not merge with a free
+     * block at the top of the heap.
+     */
+    size_t extension = MAX(asize, CHUNKSIZE);
+    if (extension >= SMALL_BLOCK_SIZE)
+        extension += (1UL << (tlsf_fls(extension) - SL_INDEX_COUNT_LOG2)) - 1;
+    if ((bp = extend_heap((extension + WORD - 1) / WORD)) == NULL)
+        return NULL;
+
+    if ((bp = find_fit(asize)) != NULL)
+    {
+        place(bp, asize);
+        return bp;
+    }
+    return NULL;
+}
+
+/*
+ * my_free - free a previously allocated block and coalesce if possible
+ */
+void my_free(void *bp)
+{
+    if (bp == NULL)
+        return;
+
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    coalesce(bp);
+}
+
+void *my_realloc(void *ptr, size_t size)
+{
+    if (size == 0)
+    {
+        my_free(ptr);
+        return NULL;
+    }
+
+    if (ptr == NULL)
+    {
+        return my_malloc(size);
+    }
+
+    if (size > MAX_REQUEST)
+        return NULL;
+
+    size_t asize = adjust_size(size);
+    size_t old_size = GET_SIZE(HDRP(ptr));
+
+    if (asize <= old_size)
+    {
+        /* Shrink or no change: split if fragment is large enough */
+        if ((old_size - asize) >= (2 * DWORD))
+        {
+            PUT(HDRP(ptr), PACK(asize, 1));
+            PUT(FTRP(ptr), PACK(asize, 1));
+
+            void *next_ptr = NXT_BLOCK(ptr);
+            PUT(HDRP(next_ptr), PACK(old_size - asize, 0));
+            PUT(FTRP(next_ptr), PACK(old_size - asize, 0));
+
+            coalesce(next_ptr);
+        }
+        return ptr;
+    }
+
+    /* Need to grow: try to use free adjacent block without moving data */
+    size_t next_alloc = GET_ALLOC(HDRP(NXT_BLOCK(ptr)));
+    size_t next_size = GET_SIZE(HDRP(NXT_BLOCK(ptr)));
+    size_t total_avail = old_size + next_size;
+
+    if (!next_alloc && (total_avail >= asize))
+    {
+        delete_node(NXT_BLOCK(ptr));
+
+        if ((total_avail - asize) >= (2 * DWORD))
+        {
+            PUT(HDRP(ptr), PACK(asize, 1));
+            PUT(FTRP(ptr), PACK(asize, 1));
+
+            void *remainder_ptr = NXT_BLOCK(ptr);
+            PUT(HDRP(remainder_ptr), PACK(total_avail - asize, 0));
+            PUT(FTRP(remainder_ptr), PACK(total_avail - asize, 0));
+            insert_node(remainder_ptr);
+        }
+        else
+        {
+            PUT(HDRP(ptr), PACK(total_avail, 1));
+            PUT(FTRP(ptr), PACK(total_avail, 1));
+        }
+        return ptr;
+    }
+
+    /* Can't realloc in-place; allocate new block and copy data */
+    void *new_ptr = my_malloc(size);
+    if (new_ptr == NULL)
+        return NULL;
+
+    size_t copy_size = old_size - DWORD;
+    if (size < copy_size)
+        copy_size = size;
+
+    memcpy(new_ptr, ptr, copy_size);
+    my_free(ptr);
+
+    return new_ptr;
+}
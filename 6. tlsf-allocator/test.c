@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* --- WHITE BOX TESTING --- */
+// Include the source directly to access the bitmaps and class lists
+#include "alloc.c"
+
+#define ANSI_COLOR_RED "\x1b[31m"
+#define ANSI_COLOR_GREEN "\x1b[32m"
+#define ANSI_COLOR_RESET "\x1b[0m"
+
+int tests_passed = 0;
+int tests_total = 0;
+
+/* --- TEST MACROS --- */
+#define TEST_ASSERT(cond, msg)                                           \
+    do                                                                   \
+    {                                                                    \
+        tests_total++;                                                   \
+        if (!(cond))                                                     \
+        {                                                                \
+            printf(ANSI_COLOR_RED "FAIL: %s\n" ANSI_COLOR_RESET, msg);   \
+            return;                                                      \
+        }                                                                \
+        else                                                             \
+        {                                                                \
+            printf(ANSI_COLOR_GREEN "PASS: %s\n" ANSI_COLOR_RESET, msg); \
+            tests_passed++;                                              \
+        }                                                                \
+    } while (0)
+
+/* --- INTEGRITY CHECKER --- */
+// Validates every class list against the bitmaps
+int check_tlsf_integrity()
+{
+    for (int fl = 0; fl < FL_INDEX_COUNT; fl++)
+    {
+        if (((fl_bitmap >> fl) & 1) != (sl_bitmap[fl] != 0))
+        {
+            printf("ERROR: fl_bitmap bit %d disagrees with sl_bitmap.\n", fl);
+            return 0;
+        }
+
+        for (int sl = 0; sl < SL_INDEX_COUNT; sl++)
+        {
+            char *bp = blocks[fl][sl];
+            char *prev = NULL;
+
+            if (((sl_bitmap[fl] >> sl) & 1) != (bp != NULL))
+            {
+                printf("ERROR: sl_bitmap[%d] bit %d disagrees with list.\n", fl, sl);
+                return 0;
+            }
+
+            while (bp != NULL)
+            {
+                int f, s;
+                mapping_insert(GET_SIZE(HDRP(bp)), &f, &s);
+
+                if (GET_ALLOC(HDRP(bp)) != 0)
+                {
+                    printf("ERROR: Block %p in free list is ALLOCATED.\n", bp);
+                    return 0;
+                }
+                if (f != fl || s != sl)
+                {
+                    printf("ERROR: Block %p filed under (%d,%d), belongs in (%d,%d).\n", bp, fl, sl, f, s);
+                    return 0;
+                }
+                if (GET_PRV_PTR(bp) != prev)
+                {
+                    printf("ERROR: Broken Back-Link at %p.\n", bp);
+                    return 0;
+                }
+                prev = bp;
+                bp = GET_NXT_PTR(bp);
+            }
+        }
+    }
+    return 1;
+}
+
+/* --- TEST CASES --- */
+
+void test_initialization()
+{
+    printf("\n=== Test 1: Initialization ===\n");
+    heap_list_p = 0;
+    TEST_ASSERT(mminit() == 0, "mminit returns success");
+    TEST_ASSERT(fl_bitmap != 0, "Initial chunk is indexed");
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+}
+
+void test_mapping()
+{
+    printf("\n=== Test 2: Two-Level Mapping ===\n");
+    int fl, sl;
+
+    mapping_insert(32, &fl, &sl);
+    TEST_ASSERT(fl == 0 && sl == 2, "32 bytes -> small class (0,2)");
+
+    mapping_insert(SMALL_BLOCK_SIZE, &fl, &sl);
+    TEST_ASSERT(fl == 1 && sl == 0, "SMALL_BLOCK_SIZE starts first level 1");
+
+    mapping_insert(4096 + 256, &fl, &sl);
+    TEST_ASSERT(fl == 5 && sl == 1, "4352 bytes -> (5,1)");
+
+    // Search rounds up: 4100 is inside class (5,0) but not guaranteed to fit it
+    mapping_search(4100, &fl, &sl);
+    TEST_ASSERT(fl == 5 && sl == 1, "Search for 4100 starts at next class (5,1)");
+}
+
+void test_basic_malloc()
+{
+    printf("\n=== Test 3: Basic Malloc & Alignment ===\n");
+    mminit();
+
+    char *p1 = my_malloc(1);
+    TEST_ASSERT(p1 != NULL, "Malloc returned pointer");
+    TEST_ASSERT((uintptr_t)p1 % 16 == 0, "Pointer is 16-byte aligned");
+    TEST_ASSERT(GET_SIZE(HDRP(p1)) == 32, "Block size meets minimum (32 bytes)");
+
+    *p1 = 'X';
+    TEST_ASSERT(*p1 == 'X', "Memory is writable");
+
+    my_free(p1);
+    TEST_ASSERT(GET_ALLOC(HDRP(p1)) == 0, "Block marked free after free()");
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+}
+
+void test_bitmap_tracking()
+{
+    printf("\n=== Test 4: Bitmap Tracks Free Classes ===\n");
+    mminit();
+
+    char *a = my_malloc(64);
+    char *guard = my_malloc(64);
+    my_free(a);
+
+    int fl, sl;
+    mapping_insert(GET_SIZE(HDRP(a)), &fl, &sl);
+    TEST_ASSERT(blocks[fl][sl] == a, "Freed block heads its class list");
+    TEST_ASSERT((sl_bitmap[fl] >> sl) & 1, "Second-level bit set");
+
+    char *b = my_malloc(64);
+    TEST_ASSERT(b == a, "Exact class reused");
+    TEST_ASSERT(!((sl_bitmap[fl] >> sl) & 1), "Second-level bit cleared when list empties");
+
+    my_free(b);
+    my_free(guard);
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+}
+
+void test_coalescing()
+{
+    printf("\n=== Test 5: Coalescing (Left-Middle-Right) ===\n");
+    mminit();
+
+    char *left = my_malloc(64);
+    char *middle = my_malloc(64);
+    char *right = my_malloc(64);
+
+    my_free(left);
+    my_free(right);
+    my_free(middle);
+
+    // Everything merges back into the single initial chunk
+    TEST_ASSERT(GET_SIZE(HDRP(left)) >= CHUNKSIZE, "Merged back into one block starting at Left");
+    TEST_ASSERT(GET_SIZE(HDRP(NXT_BLOCK(left))) == 0, "Next block is the epilogue");
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+}
+
+void test_good_fit()
+{
+    printf("\n=== Test 6: Good Fit Skips Too-Small Blocks ===\n");
+    mminit();
+
+    // 4112-byte and 8208-byte free holes separated by allocated guards
+    char *small_hole = my_malloc(4096);
+    char *g1 = my_malloc(32);
+    char *big_hole = my_malloc(8192);
+    char *g2 = my_malloc(32);
+    TEST_ASSERT(g1 != NULL && g2 != NULL, "Guards allocated");
+    my_free(small_hole);
+    my_free(big_hole);
+
+    // 4200 falls in the same first-level row as the small hole but does not fit it
+    char *p = my_malloc(4200);
+    TEST_ASSERT(p != NULL && p != small_hole, "Request served from a class that is guaranteed to fit");
+    TEST_ASSERT(GET_SIZE(HDRP(p)) >= 4200 + DWORD, "Returned block is large enough");
+    TEST_ASSERT(GET_ALLOC(HDRP(small_hole)) == 0, "Smaller hole left alone");
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+}
+
+void test_realloc()
+{
+    printf("\n=== Test 7: Realloc ===\n");
+    mminit();
+
+    char *a = my_malloc(64);
+    strcpy(a, "Testing123");
+
+    // Next block is the free remainder of the chunk: grows in place
+    char *grown = my_realloc(a, 200);
+    TEST_ASSERT(grown == a, "Grew in place into free neighbour");
+
+    char *guard = my_malloc(32);
+    char *moved = my_realloc(grown, 1000);
+    TEST_ASSERT(moved != grown && GET_ALLOC(HDRP(guard)), "Pointer moved past the guard (Fallback)");
+    TEST_ASSERT(strcmp(moved, "Testing123") == 0, "Data preserved");
+
+    char *shrunk = my_realloc(moved, 16);
+    TEST_ASSERT(shrunk == moved, "Shrink stays in place");
+    TEST_ASSERT(my_realloc(shrunk, SIZE_MAX - 8) == NULL, "Oversized request rejected");
+    TEST_ASSERT(GET_ALLOC(HDRP(shrunk)) && strcmp(shrunk, "Testing123") == 0, "Block kept on failure");
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+}
+
+void test_max_blocks()
+{
+    printf("\n=== Test 8: Coalescing Stops At The Largest Class ===\n");
+    mminit();
+
+    // Three adjacent maximum-size requests: merged, they would need a first-level row past the last
+    char *blk[3];
+    for (int i = 0; i < 3; i++)
+        blk[i] = my_malloc(MAX_REQUEST);
+    TEST_ASSERT(blk[0] && blk[1] && blk[2], "Three maximum-size blocks allocated");
+    TEST_ASSERT(NXT_BLOCK(blk[0]) == blk[1] && NXT_BLOCK(blk[1]) == blk[2], "Blocks are adjacent");
+
+    my_free(blk[0]);
+    my_free(blk[2]);
+    my_free(blk[1]);
+    TEST_ASSERT(GET_SIZE(HDRP(blk[0])) <= MAX_BLOCK && GET_SIZE(HDRP(blk[2])) <= MAX_BLOCK, "No free block passes MAX_BLOCK");
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+
+    char *again = my_malloc(MAX_REQUEST);
+    TEST_ASSERT(again != NULL, "Maximum-size request served from the freed blocks");
+    TEST_ASSERT(check_tlsf_integrity(), "Bitmap/list integrity check");
+}
+
+/* --- MAIN --- */
+int main()
+{
+    printf("--- TLSF Allocator Unit Tests ---\n");
+
+    test_initialization();
+    test_mapping();
+    test_basic_malloc();
+    test_bitmap_tracking();
+    test_coalescing();
+    test_good_fit();
+    test_realloc();
+    test_max_blocks();
+
+    printf("\n------------------------------------------------\n");
+    printf("Summary: %d / %d Tests Passed.\n", tests_passed, tests_total);
+
+    if (tests_passed == tests_total)
+    {
+        printf(ANSI_COLOR_GREEN "ALL TESTS PASSED.\n" ANSI_COLOR_RESET);
+    }
+    else
+    {
+        printf(ANSI_COLOR_RED "FAILURES DETECTED.\n" ANSI_COLOR_RESET);
+    }
+    return 0;
+}